@@ -78,6 +78,8 @@
 
 #define MADV_COLLAPSE	25		/* Synchronous hugepage collapse */
 
+#define MADV_POPULATE_LOCKED	26	/* mlock and populate, THP where possible */
+
 /* compatibility flags */
 #define MAP_FILE	0
 
@@ -249,6 +249,8 @@ extern void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
 				unsigned long end, unsigned int stride_shift,
 				bool freed_tables);
 extern void flush_tlb_kernel_range(unsigned long start, unsigned long end);
+extern void flush_tlb_kernel_range_mask(unsigned long start, unsigned long end,
+					const struct cpumask *mask);
 
 static inline void flush_tlb_page(struct vm_area_struct *vma, unsigned long a)
 {
@@ -93,6 +93,7 @@ static const char *const blk_queue_flag_name[] = {
 	QUEUE_FLAG_NAME(RQ_ALLOC_TIME),
 	QUEUE_FLAG_NAME(HCTX_ACTIVE),
 	QUEUE_FLAG_NAME(SQ_SCHED),
+	QUEUE_FLAG_NAME(HK_COMP),
 };
 #undef QUEUE_FLAG_NAME
 
@@ -497,6 +498,26 @@ static int hctx_dispatch_busy_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int hctx_completions_show(void *data, struct seq_file *m)
+{
+	struct blk_mq_hw_ctx *hctx = data;
+	unsigned long local = 0, ipi = 0, redirected = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_comp_stats *stats =
+			per_cpu_ptr(hctx->comp_stats, cpu);
+
+		local += data_race(stats->local);
+		ipi += data_race(stats->ipi);
+		redirected += data_race(stats->redirected);
+	}
+
+	seq_printf(m, "local %lu\nipi %lu\nredirected %lu\n",
+		   local, ipi, redirected);
+	return 0;
+}
+
 #define CTX_RQ_SEQ_OPS(name, type)					\
 static void *ctx_##name##_rq_list_start(struct seq_file *m, loff_t *pos) \
 	__acquires(&ctx->lock)						\
@@ -612,6 +633,7 @@ static const struct blk_mq_debugfs_attr blk_mq_debugfs_hctx_attrs[] = {
 	{"active", 0400, hctx_active_show},
 	{"dispatch_busy", 0400, hctx_dispatch_busy_show},
 	{"type", 0400, hctx_type_show},
+	{"completions", 0400, hctx_completions_show},
 	{},
 };
 
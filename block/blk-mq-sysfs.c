@@ -35,6 +35,7 @@ static void blk_mq_hw_sysfs_release(struct kobject *kobj)
 						  kobj);
 
 	blk_free_flush_queue(hctx->fq);
+	free_percpu(hctx->comp_stats);
 	sbitmap_free(&hctx->ctx_map);
 	free_cpumask_var(hctx->cpumask);
 	kfree(hctx->ctxs);
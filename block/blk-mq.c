@@ -1228,7 +1228,65 @@ static void __blk_mq_complete_request_remote(void *data)
 	__raise_softirq_irqoff(BLOCK_SOFTIRQ);
 }
 
-static inline bool blk_mq_complete_need_ipi(struct request *rq)
+#define blk_mq_comp_inc(hctx, field)	this_cpu_inc((hctx)->comp_stats->field)
+
+/*
+ * Housekeeping CPU to complete the requests of an isolated CPU on. As the
+ * isolation and the topology can change at runtime, the entry is checked
+ * on use, and a failed search is only repeated after a second.
+ */
+struct blk_mq_hk_comp {
+	int		cpu;		/* -1 if there is none */
+	unsigned long	retry;
+};
+static DEFINE_PER_CPU(struct blk_mq_hk_comp, blk_mq_hk_comp);
+
+static int blk_mq_hk_comp_cpu(int target)
+{
+	struct blk_mq_hk_comp *hc = per_cpu_ptr(&blk_mq_hk_comp, target);
+	int hk = READ_ONCE(hc->cpu);
+
+	if (hk < 0) {
+		if (time_before(jiffies, READ_ONCE(hc->retry)))
+			return -1;
+	} else if (cpu_online(hk) && !cpu_is_isolated(hk) &&
+		   cpus_share_cache(hk, target)) {
+		return hk;
+	}
+
+	for_each_online_cpu(hk) {
+		if (!cpu_is_isolated(hk) && cpus_share_cache(hk, target)) {
+			WRITE_ONCE(hc->cpu, hk);
+			return hk;
+		}
+	}
+	WRITE_ONCE(hc->retry, jiffies + HZ);
+	WRITE_ONCE(hc->cpu, -1);
+	return -1;
+}
+
+/*
+ * The CPU to complete @rq on. That is the submitting CPU, unless the queue
+ * keeps completions off isolated CPUs and the submitter is one: then it is
+ * @cpu if that is a housekeeping CPU sharing a cache with the submitter, or
+ * another such CPU, or @cpu if there are none. The submitter is then
+ * woken up from there rather than interrupted to run the completion.
+ */
+static int blk_mq_complete_cpu(struct request *rq, int cpu)
+{
+	int target = rq->mq_ctx->cpu, hk;
+
+	if (!test_bit(QUEUE_FLAG_HK_COMP, &rq->q->queue_flags) ||
+	    !cpu_is_isolated(target))
+		return target;
+
+	if (!cpu_is_isolated(cpu) && cpus_share_cache(cpu, target))
+		return cpu;
+	hk = blk_mq_hk_comp_cpu(target);
+	return hk >= 0 ? hk : cpu;
+}
+
+static inline bool blk_mq_complete_need_ipi(struct request *rq, int target)
 {
 	int cpu = raw_smp_processor_id();
 
@@ -1245,21 +1303,18 @@ static inline bool blk_mq_complete_need_ipi(struct request *rq)
 		return false;
 
 	/* same CPU or cache domain and capacity?  Complete locally */
-	if (cpu == rq->mq_ctx->cpu ||
+	if (cpu == target ||
 	    (!test_bit(QUEUE_FLAG_SAME_FORCE, &rq->q->queue_flags) &&
-	     cpus_share_cache(cpu, rq->mq_ctx->cpu) &&
-	     cpus_equal_capacity(cpu, rq->mq_ctx->cpu)))
+	     cpus_share_cache(cpu, target) &&
+	     cpus_equal_capacity(cpu, target)))
 		return false;
 
 	/* don't try to IPI to an offline CPU */
-	return cpu_online(rq->mq_ctx->cpu);
+	return cpu_online(target);
 }
 
-static void blk_mq_complete_send_ipi(struct request *rq)
+static void blk_mq_complete_send_ipi(struct request *rq, unsigned int cpu)
 {
-	unsigned int cpu;
-
-	cpu = rq->mq_ctx->cpu;
 	if (llist_add(&rq->ipi_list, &per_cpu(blk_cpu_done, cpu)))
 		smp_call_function_single_async(cpu, &per_cpu(blk_cpu_csd, cpu));
 }
@@ -1277,6 +1332,10 @@ static void blk_mq_raise_softirq(struct request *rq)
 
 bool blk_mq_complete_request_remote(struct request *rq)
 {
+	struct blk_mq_hw_ctx *hctx = rq->mq_hctx;
+	bool moved = false;
+	int cpu, target;
+
 	WRITE_ONCE(rq->state, MQ_RQ_COMPLETE);
 
 	/*
@@ -1287,18 +1346,47 @@ bool blk_mq_complete_request_remote(struct request *rq)
 	if ((rq->mq_hctx->nr_ctx == 1 &&
 	     rq->mq_ctx->cpu == raw_smp_processor_id()) ||
 	     rq->cmd_flags & REQ_POLLED)
-		return false;
+		goto local;
 
-	if (blk_mq_complete_need_ipi(rq)) {
-		blk_mq_complete_send_ipi(rq);
+	cpu = raw_smp_processor_id();
+	target = blk_mq_complete_cpu(rq, cpu);
+	if (target != rq->mq_ctx->cpu) {
+		/*
+		 * Redirected off an isolated submitter. Send it to the
+		 * housekeeping CPU even if it shares a cache with this one,
+		 * which may be isolated as well. As in
+		 * blk_mq_complete_need_ipi(), don't IPI if that would only
+		 * wake ksoftirqd, and complete in place instead.
+		 */
+		if (target == cpu) {
+			moved = !cpu_is_isolated(cpu);
+		} else if (IS_ENABLED(CONFIG_SMP) && !force_irqthreads() &&
+			   cpu_online(target)) {
+			blk_mq_comp_inc(hctx, redirected);
+			blk_mq_complete_send_ipi(rq, target);
+			return true;
+		}
+	} else if (blk_mq_complete_need_ipi(rq, target)) {
+		blk_mq_comp_inc(hctx, ipi);
+		blk_mq_complete_send_ipi(rq, target);
 		return true;
 	}
 
+	/* completed on this CPU, count each request once */
+	if (moved)
+		blk_mq_comp_inc(hctx, redirected);
+	else
+		blk_mq_comp_inc(hctx, local);
+
 	if (rq->q->nr_hw_queues == 1) {
 		blk_mq_raise_softirq(rq);
 		return true;
 	}
 	return false;
+
+local:
+	blk_mq_comp_inc(hctx, local);
+	return false;
 }
 EXPORT_SYMBOL_GPL(blk_mq_complete_request_remote);
 
@@ -2820,6 +2908,69 @@ static void __blk_mq_flush_plug_list(struct request_queue *q,
 	q->mq_ops->queue_rqs(&plug->mq_list);
 }
 
+/*
+ * Issue the plugged requests, which all belong to one queue, through
+ * ->queue_rqs() or directly with one ->commit_rqs() per hardware queue.
+ * Requests that couldn't be issued are left on the plug.
+ */
+static void blk_mq_dispatch_queue_requests(struct blk_plug *plug,
+					   unsigned int depth)
+{
+	struct request_queue *q = rq_list_peek(&plug->mq_list)->q;
+
+	trace_block_unplug(q, depth, true);
+
+	/*
+	 * Peek first request and see if we have a ->queue_rqs() hook.
+	 * If we do, we can dispatch the whole plug list in one go.
+	 */
+	if (q->mq_ops->queue_rqs) {
+		blk_mq_run_dispatch_ops(q,
+			__blk_mq_flush_plug_list(q, plug));
+		if (rq_list_empty(plug->mq_list))
+			return;
+	}
+
+	blk_mq_run_dispatch_ops(q,
+			blk_mq_plug_issue_direct(plug));
+}
+
+/*
+ * Requests striped over several devices: split the plug per queue so that
+ * each queue still gets its requests in one batch, instead of falling back
+ * to inserting them one hardware context at a time.
+ */
+static void blk_mq_dispatch_multiple_queue_requests(struct blk_plug *plug)
+{
+	struct request *rest = plug->mq_list;
+	struct request *leftover = NULL, **leftoverp = &leftover;
+
+	do {
+		struct request_queue *q = rq_list_peek(&rest)->q;
+		struct request *list = NULL, **listp = &list;
+		struct request *requeue = NULL, **requeuep = &requeue;
+		unsigned int depth = 0;
+		struct request *rq;
+
+		while ((rq = rq_list_pop(&rest))) {
+			if (rq->q == q) {
+				rq_list_add_tail(&listp, rq);
+				depth++;
+			} else {
+				rq_list_add_tail(&requeuep, rq);
+			}
+		}
+		rest = requeue;
+
+		plug->mq_list = list;
+		blk_mq_dispatch_queue_requests(plug, depth);
+		while ((rq = rq_list_pop(&plug->mq_list)))
+			rq_list_add_tail(&leftoverp, rq);
+	} while (!rq_list_empty(rest));
+
+	plug->mq_list = leftover;
+}
+
 static void blk_mq_dispatch_plug_list(struct blk_plug *plug, bool from_sched)
 {
 	struct blk_mq_hw_ctx *this_hctx = NULL;
@@ -2868,7 +3019,6 @@ static void blk_mq_dispatch_plug_list(struct blk_plug *plug, bool from_sched)
 
 void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 {
-	struct request *rq;
 	unsigned int depth;
 
 	/*
@@ -2883,28 +3033,11 @@ void blk_mq_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 	depth = plug->rq_count;
 	plug->rq_count = 0;
 
-	if (!plug->multiple_queues && !plug->has_elevator && !from_schedule) {
-		struct request_queue *q;
-
-		rq = rq_list_peek(&plug->mq_list);
-		q = rq->q;
-		trace_block_unplug(q, depth, true);
-
-		/*
-		 * Peek first request and see if we have a ->queue_rqs() hook.
-		 * If we do, we can dispatch the whole plug list in one go. We
-		 * already know at this point that all requests belong to the
-		 * same queue, caller must ensure that's the case.
-		 */
-		if (q->mq_ops->queue_rqs) {
-			blk_mq_run_dispatch_ops(q,
-				__blk_mq_flush_plug_list(q, plug));
-			if (rq_list_empty(plug->mq_list))
-				return;
-		}
-
-		blk_mq_run_dispatch_ops(q,
-				blk_mq_plug_issue_direct(plug));
+	if (!plug->has_elevator && !from_schedule) {
+		if (plug->multiple_queues)
+			blk_mq_dispatch_multiple_queue_requests(plug);
+		else
+			blk_mq_dispatch_queue_requests(plug, depth);
 		if (rq_list_empty(plug->mq_list))
 			return;
 	}
@@ -2976,6 +3109,19 @@ static struct request *blk_mq_get_new_requests(struct request_queue *q,
 	if (plug) {
 		data.nr_tags = plug->nr_ios;
 		plug->nr_ios = 1;
+		/*
+		 * The batch went to another queue. Assume the IO is striped
+		 * evenly, and that this queue will see as many requests as
+		 * are still cached for the others.
+		 */
+		if (data.nr_tags == 1 && !rq_list_empty(plug->cached_rq)) {
+			struct request *cached;
+
+			rq_list_for_each(&plug->cached_rq, cached)
+				data.nr_tags++;
+			data.nr_tags = min_t(unsigned int, data.nr_tags,
+					     BLK_MAX_REQUEST_COUNT);
+		}
 		data.cached_rq = &plug->cached_rq;
 	}
 
@@ -2999,28 +3145,36 @@ static struct request *blk_mq_peek_cached_request(struct blk_plug *plug,
 
 	if (!plug)
 		return NULL;
-	rq = rq_list_peek(&plug->cached_rq);
-	if (!rq || rq->q != q)
-		return NULL;
-	if (type != rq->mq_hctx->type &&
-	    (type != HCTX_TYPE_READ || rq->mq_hctx->type != HCTX_TYPE_DEFAULT))
-		return NULL;
-	if (op_is_flush(rq->cmd_flags) != op_is_flush(opf))
-		return NULL;
-	return rq;
+	/* with IO striped over several queues, the cache holds all of them */
+	rq_list_for_each(&plug->cached_rq, rq) {
+		if (rq->q != q)
+			continue;
+		if (type != rq->mq_hctx->type &&
+		    (type != HCTX_TYPE_READ ||
+		     rq->mq_hctx->type != HCTX_TYPE_DEFAULT))
+			return NULL;
+		if (op_is_flush(rq->cmd_flags) != op_is_flush(opf))
+			return NULL;
+		return rq;
+	}
+	return NULL;
 }
 
 static void blk_mq_use_cached_rq(struct request *rq, struct blk_plug *plug,
 		struct bio *bio)
 {
-	WARN_ON_ONCE(rq_list_peek(&plug->cached_rq) != rq);
+	struct request **prevp = &plug->cached_rq;
+
+	while (*prevp && *prevp != rq)
+		prevp = &rq_list_next(*prevp);
 
 	/*
 	 * If any qos ->throttle() end up blocking, we will have flushed the
 	 * plug and hence killed the cached_rq list as well. Pop this entry
 	 * before we throttle.
 	 */
-	plug->cached_rq = rq_list_next(rq);
+	if (!WARN_ON_ONCE(!*prevp))
+		*prevp = rq_list_next(rq);
 	rq_qos_throttle(rq->q, bio);
 
 	blk_mq_rq_time_init(rq, 0);
@@ -3954,6 +4108,10 @@ blk_mq_alloc_hctx(struct request_queue *q, struct blk_mq_tag_set *set,
 	if (!zalloc_cpumask_var_node(&hctx->cpumask, gfp, node))
 		goto free_hctx;
 
+	hctx->comp_stats = alloc_percpu_gfp(struct blk_mq_comp_stats, gfp);
+	if (!hctx->comp_stats)
+		goto free_cpumask;
+
 	atomic_set(&hctx->nr_active, 0);
 	if (node == NUMA_NO_NODE)
 		node = set->numa_node;
@@ -3976,7 +4134,7 @@ blk_mq_alloc_hctx(struct request_queue *q, struct blk_mq_tag_set *set,
 	hctx->ctxs = kmalloc_array_node(nr_cpu_ids, sizeof(void *),
 			gfp, node);
 	if (!hctx->ctxs)
-		goto free_cpumask;
+		goto free_comp_stats;
 
 	if (sbitmap_init_node(&hctx->ctx_map, nr_cpu_ids, ilog2(8),
 				gfp, node, false, false))
@@ -3999,6 +4157,8 @@ blk_mq_alloc_hctx(struct request_queue *q, struct blk_mq_tag_set *set,
 	sbitmap_free(&hctx->ctx_map);
  free_ctxs:
 	kfree(hctx->ctxs);
+ free_comp_stats:
+	free_percpu(hctx->comp_stats);
  free_cpumask:
 	free_cpumask_var(hctx->cpumask);
  free_hctx:
@@ -37,6 +37,11 @@ static const int prio_aging_expire = 10 * HZ;
 static const int writes_starved = 2;    /* max times reads can starve a write */
 static const int fifo_batch = 16;       /* # of sequential requests treated as one
 				     by the above parameters. For throughput. */
+/*
+ * Expiry for requests of SCHED_FIFO/RR tasks. SCHED_DEADLINE tasks use their
+ * relative deadline instead.
+ */
+static const int rt_expire = HZ / 50;
 
 enum dd_data_dir {
 	DD_READ		= READ,
@@ -54,6 +59,21 @@ enum dd_prio {
 
 enum { DD_PRIO_COUNT = 3 };
 
+/*
+ * Scheduling class of the task that allocated a request, if sched_deadlines
+ * was enabled at the time.
+ */
+enum dd_sched_class {
+	DD_CLASS_NORMAL	= 0,
+	DD_CLASS_RT	= 1,
+	DD_CLASS_DL	= 2,
+};
+
+enum { DD_CLASS_COUNT = 3, DD_CLASS_BITS = 2 };
+
+/* Completion latency histogram buckets, log2 of microseconds. */
+enum { DD_LAT_BUCKETS = 16 };
+
 /*
  * I/O statistics per I/O priority. It is fine if these counters overflow.
  * What matters is that these counters are at least as wide as
@@ -100,8 +120,12 @@ struct deadline_data {
 	int front_merges;
 	u32 async_depth;
 	int prio_aging_expire;
+	int sched_deadlines;
+	int rt_expire;
 
 	spinlock_t lock;
+
+	atomic_t latency[DD_CLASS_COUNT][DD_LAT_BUCKETS];
 };
 
 /* Maps an I/O priority class to a deadline scheduler priority. */
@@ -127,6 +151,42 @@ static u8 dd_rq_ioclass(struct request *rq)
 	return IOPRIO_PRIO_CLASS(req_get_ioprio(rq));
 }
 
+/*
+ * With sched_deadlines, dd_prepare_request() stores the scheduling class of
+ * the submitting task in rq->elv.priv[1], together with the expiry it asks
+ * for.
+ */
+static enum dd_sched_class dd_rq_class(struct request *rq)
+{
+	return (uintptr_t)rq->elv.priv[1] & ((1 << DD_CLASS_BITS) - 1);
+}
+
+/* The expiry time of @rq relative to its insertion, in jiffies. */
+static unsigned long dd_rq_expire(struct deadline_data *dd,
+				  struct request *rq)
+{
+	unsigned long expire = dd->fifo_expire[rq_data_dir(rq)];
+
+	if (dd_rq_class(rq) != DD_CLASS_NORMAL)
+		expire = min(expire,
+			     (uintptr_t)rq->elv.priv[1] >> DD_CLASS_BITS);
+	return expire;
+}
+
+/*
+ * Requests of RT and deadline tasks without an explicit I/O priority are
+ * treated as IOPRIO_CLASS_RT.
+ */
+static enum dd_prio dd_rq_prio(struct request *rq)
+{
+	u8 ioprio_class = dd_rq_ioclass(rq);
+
+	if (ioprio_class == IOPRIO_CLASS_NONE &&
+	    dd_rq_class(rq) != DD_CLASS_NORMAL)
+		return DD_RT_PRIO;
+	return ioprio_class_to_prio[ioprio_class];
+}
+
 /*
  * Return the first request for which blk_rq_pos() >= @pos.
  */
@@ -190,8 +250,7 @@ static void dd_request_merged(struct request_queue *q, struct request *req,
 			      enum elv_merge type)
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
-	const u8 ioprio_class = dd_rq_ioclass(req);
-	const enum dd_prio prio = ioprio_class_to_prio[ioprio_class];
+	const enum dd_prio prio = dd_rq_prio(req);
 	struct dd_per_prio *per_prio = &dd->per_prio[prio];
 
 	/*
@@ -210,8 +269,7 @@ static void dd_merged_requests(struct request_queue *q, struct request *req,
 			       struct request *next)
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
-	const u8 ioprio_class = dd_rq_ioclass(next);
-	const enum dd_prio prio = ioprio_class_to_prio[ioprio_class];
+	const enum dd_prio prio = dd_rq_prio(next);
 
 	lockdep_assert_held(&dd->lock);
 
@@ -219,9 +277,11 @@ static void dd_merged_requests(struct request_queue *q, struct request *req,
 
 	/*
 	 * if next expires before rq, assign its expire time to rq
-	 * and move into next position (next will be deleted) in fifo
+	 * and move into next position (next will be deleted) in fifo,
+	 * unless they were queued at different priorities.
 	 */
-	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist)) {
+	if (!list_empty(&req->queuelist) && !list_empty(&next->queuelist) &&
+	    dd_rq_prio(req) == prio) {
 		if (time_before((unsigned long)next->fifo_time,
 				(unsigned long)req->fifo_time)) {
 			list_move(&req->queuelist, &next->queuelist);
@@ -305,7 +365,7 @@ static bool started_after(struct deadline_data *dd, struct request *rq,
 {
 	unsigned long start_time = (unsigned long)rq->fifo_time;
 
-	start_time -= dd->fifo_expire[rq_data_dir(rq)];
+	start_time -= dd_rq_expire(dd, rq);
 
 	return time_after(start_time, latest_start);
 }
@@ -321,7 +381,6 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd,
 	struct request *rq, *next_rq;
 	enum dd_data_dir data_dir;
 	enum dd_prio prio;
-	u8 ioprio_class;
 
 	lockdep_assert_held(&dd->lock);
 
@@ -415,8 +474,7 @@ static struct request *__dd_dispatch_request(struct deadline_data *dd,
 	dd->batching++;
 	deadline_move_request(dd, per_prio, rq);
 done:
-	ioprio_class = dd_rq_ioclass(rq);
-	prio = ioprio_class_to_prio[ioprio_class];
+	prio = dd_rq_prio(rq);
 	dd->per_prio[prio].latest_pos[data_dir] = blk_rq_pos(rq);
 	dd->per_prio[prio].stats.dispatched++;
 	rq->rq_flags |= RQF_STARTED;
@@ -601,6 +659,8 @@ static int dd_init_sched(struct request_queue *q, struct elevator_type *e)
 	dd->last_dir = DD_WRITE;
 	dd->fifo_batch = fifo_batch;
 	dd->prio_aging_expire = prio_aging_expire;
+	dd->sched_deadlines = 1;
+	dd->rt_expire = rt_expire;
 	spin_lock_init(&dd->lock);
 
 	/* We dispatch from request queue wide instead of hw queue */
@@ -623,14 +683,20 @@ static int dd_request_merge(struct request_queue *q, struct request **rq,
 {
 	struct deadline_data *dd = q->elevator->elevator_data;
 	const u8 ioprio_class = IOPRIO_PRIO_CLASS(bio->bi_ioprio);
-	const enum dd_prio prio = ioprio_class_to_prio[ioprio_class];
-	struct dd_per_prio *per_prio = &dd->per_prio[prio];
+	enum dd_prio prio = ioprio_class_to_prio[ioprio_class];
+	struct dd_per_prio *per_prio;
 	sector_t sector = bio_end_sector(bio);
 	struct request *__rq;
 
 	if (!dd->front_merges)
 		return ELEVATOR_NO_MERGE;
 
+	/* see dd_rq_prio(), the request would be allocated by current */
+	if (ioprio_class == IOPRIO_CLASS_NONE && dd->sched_deadlines &&
+	    rt_or_dl_task_policy(current))
+		prio = DD_RT_PRIO;
+	per_prio = &dd->per_prio[prio];
+
 	__rq = elv_rb_find(&per_prio->sort_list[bio_data_dir(bio)], sector);
 	if (__rq) {
 		BUG_ON(sector != blk_rq_pos(__rq));
@@ -676,14 +742,12 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 	struct request_queue *q = hctx->queue;
 	struct deadline_data *dd = q->elevator->elevator_data;
 	const enum dd_data_dir data_dir = rq_data_dir(rq);
-	u16 ioprio = req_get_ioprio(rq);
-	u8 ioprio_class = IOPRIO_PRIO_CLASS(ioprio);
 	struct dd_per_prio *per_prio;
 	enum dd_prio prio;
 
 	lockdep_assert_held(&dd->lock);
 
-	prio = ioprio_class_to_prio[ioprio_class];
+	prio = dd_rq_prio(rq);
 	per_prio = &dd->per_prio[prio];
 	if (!rq->elv.priv[0]) {
 		per_prio->stats.inserted++;
@@ -700,6 +764,7 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		rq->fifo_time = jiffies;
 	} else {
 		struct list_head *insert_before;
+		struct request *pos;
 
 		deadline_add_rq_rb(per_prio, rq);
 
@@ -710,10 +775,19 @@ static void dd_insert_request(struct blk_mq_hw_ctx *hctx, struct request *rq,
 		}
 
 		/*
-		 * set expire time and add to fifo list
+		 * set expire time and add to fifo list, which is kept in
+		 * expiry order: requests of RT and deadline tasks can expire
+		 * before the ones queued ahead of them.
 		 */
-		rq->fifo_time = jiffies + dd->fifo_expire[data_dir];
+		rq->fifo_time = jiffies + dd_rq_expire(dd, rq);
 		insert_before = &per_prio->fifo_list[data_dir];
+		list_for_each_entry_reverse(pos, &per_prio->fifo_list[data_dir],
+					    queuelist) {
+			if (!time_after((unsigned long)pos->fifo_time,
+					(unsigned long)rq->fifo_time))
+				break;
+			insert_before = &pos->queuelist;
+		}
 		list_add_tail(&rq->queuelist, insert_before);
 	}
 }
@@ -742,10 +816,41 @@ static void dd_insert_requests(struct blk_mq_hw_ctx *hctx,
 	blk_mq_free_requests(&free);
 }
 
-/* Callback from inside blk_mq_rq_ctx_init(). */
+/*
+ * Callback from inside blk_mq_rq_ctx_init(), in the context of the task that
+ * submits the I/O.
+ */
 static void dd_prepare_request(struct request *rq)
 {
+	struct deadline_data *dd = rq->q->elevator->elevator_data;
+	enum dd_sched_class class = DD_CLASS_NORMAL;
+	unsigned long expire = 0;
+
 	rq->elv.priv[0] = NULL;
+
+	if (READ_ONCE(dd->sched_deadlines)) {
+		if (current->policy == SCHED_DEADLINE) {
+			class = DD_CLASS_DL;
+			expire = nsecs_to_jiffies(current->dl.dl_deadline);
+		} else if (rt_or_dl_task_policy(current)) {
+			class = DD_CLASS_RT;
+			expire = READ_ONCE(dd->rt_expire);
+		}
+	}
+	rq->elv.priv[1] = (void *)((expire << DD_CLASS_BITS) | class);
+}
+
+static void dd_account_latency(struct deadline_data *dd, struct request *rq)
+{
+	u64 us;
+	int bucket;
+
+	if (!rq->start_time_ns)
+		return;
+
+	us = div_u64(blk_time_get_ns() - rq->start_time_ns, NSEC_PER_USEC);
+	bucket = min_t(int, us ? ilog2(us) : 0, DD_LAT_BUCKETS - 1);
+	atomic_inc(&dd->latency[dd_rq_class(rq)][bucket]);
 }
 
 /*
@@ -755,8 +860,7 @@ static void dd_finish_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
 	struct deadline_data *dd = q->elevator->elevator_data;
-	const u8 ioprio_class = dd_rq_ioclass(rq);
-	const enum dd_prio prio = ioprio_class_to_prio[ioprio_class];
+	const enum dd_prio prio = dd_rq_prio(rq);
 	struct dd_per_prio *per_prio = &dd->per_prio[prio];
 
 	/*
@@ -764,8 +868,10 @@ static void dd_finish_request(struct request *rq)
 	 * called dd_insert_requests(). Skip requests that bypassed I/O
 	 * scheduling. See also blk_mq_request_bypass_insert().
 	 */
-	if (rq->elv.priv[0])
+	if (rq->elv.priv[0]) {
 		atomic_inc(&per_prio->stats.completed);
+		dd_account_latency(dd, rq);
+	}
 }
 
 static bool dd_has_work_for_prio(struct dd_per_prio *per_prio)
@@ -805,6 +911,8 @@ SHOW_INT(deadline_writes_starved_show, dd->writes_starved);
 SHOW_INT(deadline_front_merges_show, dd->front_merges);
 SHOW_INT(deadline_async_depth_show, dd->async_depth);
 SHOW_INT(deadline_fifo_batch_show, dd->fifo_batch);
+SHOW_INT(deadline_sched_deadlines_show, dd->sched_deadlines);
+SHOW_JIFFIES(deadline_rt_expire_show, dd->rt_expire);
 #undef SHOW_INT
 #undef SHOW_JIFFIES
 
@@ -835,6 +943,8 @@ STORE_INT(deadline_writes_starved_store, &dd->writes_starved, INT_MIN, INT_MAX);
 STORE_INT(deadline_front_merges_store, &dd->front_merges, 0, 1);
 STORE_INT(deadline_async_depth_store, &dd->async_depth, 1, INT_MAX);
 STORE_INT(deadline_fifo_batch_store, &dd->fifo_batch, 0, INT_MAX);
+STORE_INT(deadline_sched_deadlines_store, &dd->sched_deadlines, 0, 1);
+STORE_JIFFIES(deadline_rt_expire_store, &dd->rt_expire, 0, INT_MAX);
 #undef STORE_FUNCTION
 #undef STORE_INT
 #undef STORE_JIFFIES
@@ -850,6 +960,8 @@ static struct elv_fs_entry deadline_attrs[] = {
 	DD_ATTR(async_depth),
 	DD_ATTR(fifo_batch),
 	DD_ATTR(prio_aging_expire),
+	DD_ATTR(sched_deadlines),
+	DD_ATTR(rt_expire),
 	__ATTR_NULL
 };
 
@@ -988,6 +1100,27 @@ static int dd_owned_by_driver_show(void *data, struct seq_file *m)
 	return 0;
 }
 
+static int dd_latency_show(void *data, struct seq_file *m)
+{
+	static const char * const names[DD_CLASS_COUNT] = {
+		[DD_CLASS_NORMAL]	= "normal",
+		[DD_CLASS_RT]		= "rt",
+		[DD_CLASS_DL]		= "deadline",
+	};
+	struct request_queue *q = data;
+	struct deadline_data *dd = q->elevator->elevator_data;
+	int class, i;
+
+	for (class = 0; class < DD_CLASS_COUNT; class++) {
+		seq_printf(m, "%s", names[class]);
+		for (i = 0; i < DD_LAT_BUCKETS; i++)
+			seq_printf(m, " %d", atomic_read(&dd->latency[class][i]));
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
+
 #define DEADLINE_DISPATCH_ATTR(prio)					\
 static void *deadline_dispatch##prio##_start(struct seq_file *m,	\
 					     loff_t *pos)		\
@@ -1058,6 +1191,7 @@ static const struct blk_mq_debugfs_attr deadline_queue_debugfs_attrs[] = {
 	{"dispatch2", 0400, .seq_ops = &deadline_dispatch2_seq_ops},
 	{"owned_by_driver", 0400, dd_owned_by_driver_show},
 	{"queued", 0400, dd_queued_show},
+	{"latency", 0400, dd_latency_show},
 	{},
 };
 #undef DEADLINE_QUEUE_DDIR_ATTRS
@@ -528,7 +528,8 @@ void __init files_init(void)
 
 	filp_cachep = kmem_cache_create("filp", sizeof(struct file), &args,
 				SLAB_HWCACHE_ALIGN | SLAB_PANIC |
-				SLAB_ACCOUNT | SLAB_TYPESAFE_BY_RCU);
+				SLAB_ACCOUNT | SLAB_TYPESAFE_BY_RCU |
+				SLAB_PERCPU_SHEAVES);
 	percpu_counter_init(&nr_files, 0, GFP_KERNEL);
 }
 
@@ -59,6 +59,12 @@ static int seq_show(struct seq_file *m, void *v)
 		   real_mount(file->f_path.mnt)->mnt_id,
 		   file_inode(file)->i_ino);
 
+	if (S_ISREG(file_inode(file)->i_mode))
+		seq_printf(m, "ra_start:\t%lu\nra_size:\t%u\n"
+			   "ra_async_size:\t%u\nra_pages:\t%u\n",
+			   file->f_ra.start, file->f_ra.size,
+			   file->f_ra.async_size, file->f_ra.ra_pages);
+
 	/* show_fd_locks() never dereferences files, so a stale value is safe */
 	show_fd_locks(m, file, files);
 	if (seq_has_overflowed(m))
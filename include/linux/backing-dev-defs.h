@@ -160,12 +160,28 @@ struct bdi_writeback {
 #endif
 };
 
+/*
+ * Readahead feedback from the readers of a bdi, see mm/readahead.c. The
+ * atomics collect the current period, the rest is the controller state.
+ */
+struct bdi_ra_feedback {
+	bool enabled;
+	unsigned long stamp;		/* start of the current period, jiffies */
+	atomic_long_t pages;		/* pages read ahead in the period */
+	atomic_long_t stall_ns;		/* readers waiting on readahead IO */
+	atomic_t stalls;
+	unsigned long bandwidth;	/* pages per second */
+	unsigned long stall_us;		/* average wait per stall */
+	unsigned long window;		/* readahead window, in pages */
+};
+
 struct backing_dev_info {
 	u64 id;
 	struct rb_node rb_node; /* keyed by ->id */
 	struct list_head bdi_list;
 	unsigned long ra_pages;	/* max readahead in PAGE_SIZE units */
 	unsigned long io_pages;	/* max allowed IO size */
+	struct bdi_ra_feedback ra_fb;
 
 	struct kref refcnt;	/* Reference counter for the structure */
 	unsigned int capabilities; /* Device capabilities */
@@ -305,6 +305,19 @@ enum {
 	BLK_TAG_ALLOC_MAX
 };
 
+/**
+ * struct blk_mq_comp_stats - Completion counters of a hardware queue
+ * @local: Requests completed on the CPU that took the interrupt.
+ * @ipi: Requests completed on the submitting CPU via an IPI.
+ * @redirected: Requests submitted from an isolated CPU and completed on a
+ *	housekeeping CPU instead.
+ */
+struct blk_mq_comp_stats {
+	unsigned long		local;
+	unsigned long		ipi;
+	unsigned long		redirected;
+};
+
 /**
  * struct blk_mq_hw_ctx - State for a hardware queue facing the hardware
  * block device
@@ -428,6 +441,9 @@ struct blk_mq_hw_ctx {
 	 */
 	atomic_t		nr_active;
 
+	/** @comp_stats: Per CPU completion counters, see blk_mq_comp_stats. */
+	struct blk_mq_comp_stats __percpu *comp_stats;
+
 	/** @cpuhp_online: List to store request if CPU is going to die */
 	struct hlist_node	cpuhp_online;
 	/** @cpuhp_dead: List to store request if some CPU die. */
@@ -13,6 +13,7 @@
 #include <linux/time64.h>
 #include <linux/types.h>
 #include <linux/random.h>
+#include <linux/xarray.h>
 
 /* Minimal region size.  Every damon_region is aligned by this. */
 #define DAMON_MIN_REGION	PAGE_SIZE
@@ -81,6 +82,7 @@ struct damon_region {
  * @nr_regions:		Number of monitoring target regions of this target.
  * @regions_list:	Head of the monitoring target regions of this target.
  * @list:		List head for siblings.
+ * @pinned:		Parts of chunks locked by &enum DAMOS_PIN_HOT, see vaddr.c.
  *
  * Each monitoring context could have multiple targets.  For example, a context
  * for virtual memory address spaces could have multiple target processes.  The
@@ -92,6 +94,7 @@ struct damon_target {
 	unsigned int nr_regions;
 	struct list_head regions_list;
 	struct list_head list;
+	struct xarray pinned;
 };
 
 /**
@@ -107,6 +110,7 @@ struct damon_target {
  * @DAMOS_LRU_DEPRIO:	Deprioritize the region on its LRU lists.
  * @DAMOS_MIGRATE_HOT:  Migrate the regions prioritizing warmer regions.
  * @DAMOS_MIGRATE_COLD:	Migrate the regions prioritizing colder regions.
+ * @DAMOS_PIN_HOT:	Migrate, collapse and mlock the regions, warmer first.
  * @DAMOS_STAT:		Do nothing but count the stat.
  * @NR_DAMOS_ACTIONS:	Total number of DAMOS actions
  *
@@ -115,6 +119,15 @@ struct damon_target {
  * &enum DAMOS_LRU_PRIO and &enum DAMOS_LRU_DEPRIO.  &enum DAMON_OPS_PADDR
  * supports only &enum DAMOS_PAGEOUT, &enum DAMOS_LRU_PRIO, &enum
  * DAMOS_LRU_DEPRIO, and &DAMOS_STAT.
+ *
+ * &enum DAMOS_PIN_HOT migrates the region to &damos->target_nid, or to the
+ * node the target task runs on if that is %NUMA_NO_NODE, then collapses it
+ * to THPs and sets VM_LOCKED on it, so the working set of a latency
+ * critical process stays resident without sizing mlockall() statically.
+ * Regions that are not found hot again within two apply intervals of the
+ * scheme are unlocked, as is everything once monitoring stops.
+ * The time quota of the scheme bounds the CPU kdamond spends on it, and
+ * kdamond only runs on housekeeping CPUs.
  */
 enum damos_action {
 	DAMOS_WILLNEED,
@@ -126,6 +139,7 @@ enum damos_action {
 	DAMOS_LRU_DEPRIO,
 	DAMOS_MIGRATE_HOT,
 	DAMOS_MIGRATE_COLD,
+	DAMOS_PIN_HOT,
 	DAMOS_STAT,		/* Do nothing but only record the stat */
 	NR_DAMOS_ACTIONS,
 };
@@ -457,6 +471,7 @@ struct damon_ctx;
  * @apply_scheme:		Apply a DAMON-based operation scheme.
  * @target_valid:		Determine if the target is valid.
  * @cleanup:			Clean up the context.
+ * @cleanup_target:		Clean up a target before it is freed.
  *
  * DAMON can be extended for various address spaces and usages.  For this,
  * users should register the low level operations for their target address
@@ -491,6 +506,8 @@ struct damon_ctx;
  * @target_valid should check whether the target is still valid for the
  * monitoring.
  * @cleanup is called from @kdamond just before its termination.
+ * @cleanup_target is called from damon_destroy_target(), before the target's
+ * pid is put.
  */
 struct damon_operations {
 	enum damon_ops_id id;
@@ -507,6 +524,7 @@ struct damon_operations {
 			struct damos *scheme);
 	bool (*target_valid)(struct damon_target *t);
 	void (*cleanup)(struct damon_ctx *context);
+	void (*cleanup_target)(struct damon_target *t);
 };
 
 /**
@@ -749,7 +767,7 @@ struct damon_target *damon_new_target(void);
 void damon_add_target(struct damon_ctx *ctx, struct damon_target *t);
 bool damon_targets_empty(struct damon_ctx *ctx);
 void damon_free_target(struct damon_target *t);
-void damon_destroy_target(struct damon_target *t);
+void damon_destroy_target(struct damon_target *t, struct damon_ctx *ctx);
 unsigned int damon_nr_regions(struct damon_target *t);
 
 struct damon_ctx *damon_new_ctx(void);
@@ -356,6 +356,12 @@ struct io_ring_ctx {
 
 	struct wait_queue_head	sqo_sq_wait;
 	struct list_head	sqd_list;
+	/* share of the SQPOLL thread, sq_credit is private to the thread */
+	unsigned int		sq_weight;
+	unsigned int		sq_credit;
+	/* SQPOLL work for this ring, protected by uring_lock */
+	u64			sq_busy_time;
+	u64			sq_submitted;
 
 	unsigned int		file_alloc_start;
 	unsigned int		file_alloc_end;
@@ -51,6 +51,33 @@
 #define local_unlock_irqrestore(lock, flags)			\
 	__local_unlock_irqrestore(lock, flags)
 
+/**
+ * local_lock_remote_allowed - Check whether a CPU may acquire the local
+ *			       lock instance of another CPU
+ *
+ * True on PREEMPT_RT, where local_lock_t is a per CPU spinlock and thus
+ * excludes the owning CPU even when taken from elsewhere. This allows per
+ * CPU caches to be drained from a housekeeping CPU instead of queueing
+ * work on the owning CPU.
+ */
+#define local_lock_remote_allowed()	IS_ENABLED(CONFIG_PREEMPT_RT)
+
+/**
+ * local_lock_cpu - Acquire the local lock instance of @cpu
+ * @lock:	The lock variable
+ * @cpu:	The CPU owning the lock instance
+ *
+ * Must only be used if local_lock_remote_allowed() is true.
+ */
+#define local_lock_cpu(lock, cpu)	__local_lock_cpu(lock, cpu)
+
+/**
+ * local_unlock_cpu - Release the local lock instance of @cpu
+ * @lock:	The lock variable
+ * @cpu:	The CPU owning the lock instance
+ */
+#define local_unlock_cpu(lock, cpu)	__local_unlock_cpu(lock, cpu)
+
 DEFINE_GUARD(local_lock, local_lock_t __percpu*,
 	     local_lock(_T),
 	     local_unlock(_T))
@@ -3,6 +3,7 @@
 # error "Do not include directly, include linux/local_lock.h"
 #endif
 
+#include <linux/build_bug.h>
 #include <linux/percpu-defs.h>
 #include <linux/lockdep.h>
 
@@ -118,6 +119,10 @@ do {								\
 #define __local_unlock_nested_bh(lock)				\
 	local_lock_release(this_cpu_ptr(lock))
 
+/* Remote acquisition only excludes the owner on PREEMPT_RT */
+#define __local_lock_cpu(lock, cpu)		BUILD_BUG()
+#define __local_unlock_cpu(lock, cpu)		BUILD_BUG()
+
 #else /* !CONFIG_PREEMPT_RT */
 
 /*
@@ -169,4 +174,14 @@ do {								\
 	spin_unlock(this_cpu_ptr((lock)));			\
 } while (0)
 
+#define __local_lock_cpu(lock, cpu)				\
+do {								\
+	spin_lock(per_cpu_ptr((lock), (cpu)));			\
+} while (0)
+
+#define __local_unlock_cpu(lock, cpu)				\
+do {								\
+	spin_unlock(per_cpu_ptr((lock), (cpu)));		\
+} while (0)
+
 #endif /* CONFIG_PREEMPT_RT */
@@ -64,6 +64,8 @@ struct mem_cgroup_reclaim_cookie {
 
 #define MEM_CGROUP_ID_SHIFT	16
 
+#define MEMCG_RECLAIM_LAT_BUCKETS	16
+
 struct mem_cgroup_id {
 	int id;
 	refcount_t ref;
@@ -222,6 +224,14 @@ struct mem_cgroup {
 
 	int swappiness;
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	/* relative khugepaged scan budget of the member mms */
+	unsigned int khugepaged_weight;
+#endif
+
+	/* direct reclaim latencies, in log2 buckets of microseconds */
+	atomic_long_t reclaim_latency[MEMCG_RECLAIM_LAT_BUCKETS];
+
 	/* memory.events and memory.events.local */
 	struct cgroup_file events_file;
 	struct cgroup_file events_local_file;
@@ -785,6 +795,8 @@ struct mem_cgroup *get_mem_cgroup_from_mm(struct mm_struct *mm);
 
 struct mem_cgroup *get_mem_cgroup_from_current(void);
 
+void mem_cgroup_record_reclaim_latency(struct mem_cgroup *memcg, u64 ns);
+
 struct mem_cgroup *get_mem_cgroup_from_folio(struct folio *folio);
 
 struct lruvec *folio_lruvec_lock(struct folio *folio);
@@ -994,6 +1006,8 @@ unsigned long lruvec_page_state_local(struct lruvec *lruvec,
 				      enum node_stat_item idx);
 
 void mem_cgroup_flush_stats(struct mem_cgroup *memcg);
+void mem_cgroup_flush_stats_bounded(struct mem_cgroup *memcg,
+				    unsigned long max_staleness);
 void mem_cgroup_flush_stats_ratelimited(struct mem_cgroup *memcg);
 
 void __mod_lruvec_kmem_state(void *p, enum node_stat_item idx, int val);
@@ -1266,6 +1280,11 @@ static inline struct mem_cgroup *get_mem_cgroup_from_mm(struct mm_struct *mm)
 	return NULL;
 }
 
+static inline void mem_cgroup_record_reclaim_latency(struct mem_cgroup *memcg,
+						     u64 ns)
+{
+}
+
 static inline struct mem_cgroup *get_mem_cgroup_from_current(void)
 {
 	return NULL;
@@ -1461,6 +1480,11 @@ static inline void mem_cgroup_flush_stats(struct mem_cgroup *memcg)
 {
 }
 
+static inline void mem_cgroup_flush_stats_bounded(struct mem_cgroup *memcg,
+						  unsigned long max_staleness)
+{
+}
+
 static inline void mem_cgroup_flush_stats_ratelimited(struct mem_cgroup *memcg)
 {
 }
@@ -1859,6 +1883,15 @@ static inline bool mem_cgroup_zswap_writeback_enabled(struct mem_cgroup *memcg)
 }
 #endif
 
+#if defined(CONFIG_MEMCG) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+unsigned int mem_cgroup_khugepaged_weight(struct mm_struct *mm);
+#else
+static inline unsigned int mem_cgroup_khugepaged_weight(struct mm_struct *mm)
+{
+	return CGROUP_WEIGHT_DFL;
+}
+#endif
+
 
 /* Cgroup v1-related declarations */
 
@@ -152,4 +152,30 @@ static inline void mt_put_memory_types(struct list_head *memory_types)
 {
 }
 #endif	/* CONFIG_NUMA */
+
+/* kpromoted latency buckets are powers of two in microseconds */
+#define KPROMOTED_NR_LAT_BUCKETS	16
+
+struct kpromoted_stats {
+	unsigned long queued;		/* samples queued */
+	unsigned long dropped;		/* samples dropped, queue full */
+	unsigned long promoted;		/* pages promoted */
+	unsigned long failed;		/* isolated pages that failed to migrate */
+	unsigned long throttled;	/* rounds cut short by the bandwidth cap */
+	unsigned long latency[KPROMOTED_NR_LAT_BUCKETS];
+};
+
+#ifdef CONFIG_KPROMOTED
+bool kpromoted_record_access(struct folio *folio, int nid);
+void kpromoted_read_stats(int nid, struct kpromoted_stats *stats);
+#else
+static inline bool kpromoted_record_access(struct folio *folio, int nid)
+{
+	return false;
+}
+static inline void kpromoted_read_stats(int nid, struct kpromoted_stats *stats)
+{
+}
+#endif
+
 #endif  /* _LINUX_MEMORY_TIERS_H */
@@ -789,6 +789,8 @@ struct vm_area_struct {
 #endif
 #ifdef CONFIG_SWAP
 	atomic_long_t swap_readahead_info;
+	/* stride between swap faults and how often it repeated */
+	atomic_long_t swap_readahead_stride;
 #endif
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
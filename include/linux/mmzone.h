@@ -454,6 +454,8 @@ struct lru_gen_folio {
 	u8 seg;
 	/* per-node lru_gen_folio list for global reclaim */
 	struct hlist_nulls_node list;
+	/* aging on behalf of direct reclaim */
+	struct work_struct age_work;
 };
 
 enum {
@@ -665,6 +667,11 @@ enum zone_watermarks {
 #define NR_LOWORDER_PCP_LISTS (MIGRATE_PCPTYPES * (PAGE_ALLOC_COSTLY_ORDER + 1))
 #define NR_PCP_LISTS (NR_LOWORDER_PCP_LISTS + NR_PCP_THP)
 
+#ifdef CONFIG_PREEMPT_RT
+/* Order-0 pages per migratetype in the lockless pcp magazine */
+#define PCP_MAG_SLOTS 8
+#endif
+
 /*
  * Flags used in pcp->flags field.
  *
@@ -696,6 +703,10 @@ struct per_cpu_pages {
 
 	/* Lists of pages, one per migrate type stored on the pcp-lists */
 	struct list_head lists[NR_PCP_LISTS];
+#ifdef CONFIG_PREEMPT_RT
+	/* Lockless order-0 cache in front of lists, updated with cmpxchg */
+	struct page *mag[MIGRATE_PCPTYPES][PCP_MAG_SLOTS];
+#endif
 } ____cacheline_aligned_in_smp;
 
 struct per_cpu_zonestat {
@@ -53,6 +53,7 @@ enum _slab_flag_bits {
 #endif
 #ifndef CONFIG_SLUB_TINY
 	_SLAB_RECLAIM_ACCOUNT,
+	_SLAB_PERCPU_SHEAVES,
 #endif
 	_SLAB_OBJECT_POISON,
 	_SLAB_CMPXCHG_DOUBLE,
@@ -205,6 +206,24 @@ enum _slab_flag_bits {
 #endif
 #define SLAB_TEMPORARY		SLAB_RECLAIM_ACCOUNT	/* Objects are short-lived */
 
+/**
+ * define SLAB_PERCPU_SHEAVES - Cache objects in per-cpu arrays
+ *
+ * Allocations and frees on the local node are served from a per-cpu array
+ * of objects ("sheaf"), which is refilled from and flushed to the slabs in
+ * bulk. This avoids the cpu slab handling for most operations, which is
+ * especially costly on PREEMPT_RT. The price is a number of objects per cpu
+ * that stay allocated from the slab point of view, so it is only worth it
+ * for caches with hot allocation and free paths.
+ *
+ * Ignored for caches with debugging enabled and on SLUB_TINY.
+ */
+#ifndef CONFIG_SLUB_TINY
+#define SLAB_PERCPU_SHEAVES	__SLAB_FLAG_BIT(_SLAB_PERCPU_SHEAVES)
+#else
+#define SLAB_PERCPU_SHEAVES	__SLAB_FLAG_UNUSED
+#endif
+
 /* Slab created using create_boot_cache */
 #ifdef CONFIG_SLAB_OBJ_EXT
 #define SLAB_NO_OBJ_EXT		__SLAB_FLAG_BIT(_SLAB_NO_OBJ_EXT)
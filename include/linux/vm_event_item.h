@@ -77,6 +77,7 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		COMPACTSTALL, COMPACTFAIL, COMPACTSUCCESS,
 		KCOMPACTD_WAKE,
 		KCOMPACTD_MIGRATE_SCANNED, KCOMPACTD_FREE_SCANNED,
+		COMPACTRTSKIPPED,
 #endif
 #ifdef CONFIG_HUGETLB_PAGE
 		HTLB_BUDDY_PGALLOC, HTLB_BUDDY_PGALLOC_FAIL,
@@ -134,6 +135,8 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 #ifdef CONFIG_SWAP
 		SWAP_RA,
 		SWAP_RA_HIT,
+		SWAP_RA_MISS,
+		SWAP_RA_STRIDE,
 		SWPIN_ZERO,
 		SWPOUT_ZERO,
 #ifdef CONFIG_KSM
@@ -152,11 +155,33 @@ enum vm_event_item { PGPGIN, PGPGOUT, PSWPIN, PSWPOUT,
 		DIRECT_MAP_LEVEL2_SPLIT,
 		DIRECT_MAP_LEVEL3_SPLIT,
 #endif
+#ifdef CONFIG_MEMCG
+		MEMCG_STOCK_HIT,
+		MEMCG_STOCK_MISS,
+		MEMCG_STOCK_EVICT,
+		MEMCG_OBJ_STOCK_HIT,
+		MEMCG_OBJ_STOCK_MISS,
+#endif
 #ifdef CONFIG_PER_VMA_LOCK_STATS
 		VMA_LOCK_SUCCESS,
 		VMA_LOCK_ABORT,
 		VMA_LOCK_RETRY,
 		VMA_LOCK_MISS,
+		VMA_LOCK_FALLBACK_FAULT,
+		VMA_LOCK_FALLBACK_ANON,
+		VMA_LOCK_FALLBACK_DEVICE,
+		VMA_LOCK_MADVISE,
+#endif
+#ifdef CONFIG_VMALLOC_DEFER_FLUSH
+		VMAP_FLUSH_IMMEDIATE,
+		VMAP_FLUSH_DEFERRED,
+		VMAP_FLUSH_ON_ENTRY,
+#endif
+#ifdef CONFIG_SMP
+		VMSTAT_LOCAL_WORK,
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+		VMSTAT_REMOTE_FOLD,
+#endif
 #endif
 #ifdef CONFIG_DEBUG_STACK_USAGE
 		KSTACK_1K,
@@ -333,4 +333,10 @@ bool vmalloc_dump_obj(void *object);
 static inline bool vmalloc_dump_obj(void *object) { return false; }
 #endif
 
+#ifdef CONFIG_VMALLOC_DEFER_FLUSH
+void vmalloc_flush_deferred(void);
+#else
+static inline void vmalloc_flush_deferred(void) { }
+#endif
+
 #endif /* _LINUX_VMALLOC_H */
@@ -27,6 +27,7 @@ struct zswap_lruvec_state {
 unsigned long zswap_total_pages(void);
 bool zswap_store(struct folio *folio);
 bool zswap_load(struct folio *folio);
+int zswap_present_batch(swp_entry_t swp, int max_nr, bool *present);
 void zswap_invalidate(swp_entry_t swp);
 int zswap_swapon(int type, unsigned long nr_pages);
 void zswap_swapoff(int type);
@@ -49,6 +50,14 @@ static inline bool zswap_load(struct folio *folio)
 	return false;
 }
 
+static inline int zswap_present_batch(swp_entry_t swp, int max_nr,
+				      bool *present)
+{
+	if (present)
+		*present = false;
+	return max_nr;
+}
+
 static inline void zswap_invalidate(swp_entry_t swp) {}
 static inline int zswap_swapon(int type, unsigned long nr_pages)
 {
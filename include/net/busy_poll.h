@@ -48,9 +48,9 @@ void napi_busy_loop(unsigned int napi_id,
 		    bool (*loop_end)(void *, unsigned long),
 		    void *loop_end_arg, bool prefer_busy_poll, u16 budget);
 
-void napi_busy_loop_rcu(unsigned int napi_id,
-			bool (*loop_end)(void *, unsigned long),
-			void *loop_end_arg, bool prefer_busy_poll, u16 budget);
+int napi_busy_loop_rcu(unsigned int napi_id,
+		       bool (*loop_end)(void *, unsigned long),
+		       void *loop_end_arg, bool prefer_busy_poll, u16 budget);
 
 #else /* CONFIG_NET_RX_BUSY_POLL */
 static inline unsigned long net_busy_loop_on(void)
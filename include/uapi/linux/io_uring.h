@@ -612,6 +612,9 @@ enum io_uring_register_op {
 	/* clone registered buffers from source ring to current ring */
 	IORING_REGISTER_CLONE_BUFFERS		= 30,
 
+	/* set the share of the SQPOLL thread, and its priority */
+	IORING_REGISTER_SQPOLL_SCHED		= 31,
+
 	/* this goes last */
 	IORING_REGISTER_LAST,
 
@@ -697,6 +700,25 @@ struct io_uring_clock_register {
 	__u32	__resv[3];
 };
 
+/*
+ * Argument for IORING_REGISTER_SQPOLL_SCHED. Rings sharing an SQPOLL thread
+ * get SQEs submitted in proportion to their weight. With
+ * IORING_SQPOLL_SCHED_PRIO, the thread runs as SCHED_FIFO at fifo_prio, or
+ * as SCHED_NORMAL if that is 0, which needs CAP_SYS_NICE. The previous
+ * settings are copied back.
+ */
+struct io_uring_sqpoll_sched {
+	__u32	weight;		/* 0 keeps the current weight */
+	__u32	fifo_prio;
+	__u32	flags;
+	__u32	__resv[5];
+};
+
+#define IORING_SQPOLL_SCHED_PRIO	(1U << 0)
+
+#define IORING_SQPOLL_WEIGHT_DEFAULT	100
+#define IORING_SQPOLL_WEIGHT_MAX	10000
+
 enum {
 	IORING_REGISTER_SRC_REGISTERED = 1,
 };
@@ -14,6 +14,7 @@
 #include "fdinfo.h"
 #include "cancel.h"
 #include "rsrc.h"
+#include "napi.h"
 
 #ifdef CONFIG_PROC_FS
 static __cold int io_uring_show_cred(struct seq_file *m, unsigned int id,
@@ -165,6 +166,12 @@ __cold void io_uring_show_fdinfo(struct seq_file *m, struct file *file)
 	seq_printf(m, "SqThreadCpu:\t%d\n", sq_cpu);
 	seq_printf(m, "SqTotalTime:\t%llu\n", sq_total_time);
 	seq_printf(m, "SqWorkTime:\t%llu\n", sq_work_time);
+	if (has_lock && (ctx->flags & IORING_SETUP_SQPOLL)) {
+		seq_printf(m, "SqRingWeight:\t%u\n", ctx->sq_weight);
+		seq_printf(m, "SqRingBusyTime:\t%llu\n",
+			   div_u64(ctx->sq_busy_time, NSEC_PER_USEC));
+		seq_printf(m, "SqRingSubmitted:\t%llu\n", ctx->sq_submitted);
+	}
 	seq_printf(m, "UserFiles:\t%u\n", ctx->nr_user_files);
 	for (i = 0; has_lock && i < ctx->nr_user_files; i++) {
 		struct file *f = io_file_from_index(&ctx->file_table, i);
@@ -230,6 +237,8 @@ __cold void io_uring_show_fdinfo(struct seq_file *m, struct file *file)
 			seq_puts(m, "napi_prefer_busy_poll:\ttrue\n");
 		else
 			seq_puts(m, "napi_prefer_busy_poll:\tfalse\n");
+		seq_puts(m, "NapiList:\n");
+		io_napi_show_fdinfo(ctx, m);
 	} else {
 		seq_puts(m, "NAPI:\tdisabled\n");
 	}
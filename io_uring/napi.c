@@ -8,6 +8,9 @@
 /* Timeout for cleanout of stale entries. */
 #define NAPI_TIMEOUT		(60 * SEC_CONVERSION)
 
+/* Maximum number of busy loop passes an idle napi id is skipped for. */
+#define NAPI_MAX_BACKOFF	16U
+
 struct io_napi_entry {
 	unsigned int		napi_id;
 	struct list_head	list;
@@ -15,6 +18,18 @@ struct io_napi_entry {
 	unsigned long		timeout;
 	struct hlist_node	node;
 
+	/*
+	 * Polls that returned no packets double the number of passes the
+	 * entry is skipped for, a productive poll resets it. The backoff
+	 * state and the statistics are updated without napi_lock, concurrent
+	 * busy loops may lose an update.
+	 */
+	unsigned int		backoff;
+	unsigned int		skip;
+	u64			polls;
+	u64			packets;
+	u64			skipped;
+
 	struct rcu_head		rcu;
 };
 
@@ -72,6 +87,11 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock)
 
 	e->napi_id = napi_id;
 	e->timeout = jiffies + NAPI_TIMEOUT;
+	e->backoff = 0;
+	e->skip = 0;
+	e->polls = 0;
+	e->packets = 0;
+	e->skipped = 0;
 
 	spin_lock(&ctx->napi_lock);
 	if (unlikely(io_napi_hash_find(hash_list, napi_id))) {
@@ -81,32 +101,26 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock)
 	}
 
 	hlist_add_tail_rcu(&e->node, hash_list);
-	list_add_tail(&e->list, &ctx->napi_list);
+	list_add_tail_rcu(&e->list, &ctx->napi_list);
 	spin_unlock(&ctx->napi_lock);
 }
 
-static void __io_napi_remove_stale(struct io_ring_ctx *ctx)
+/*
+ * Remove a stale entry found by the busy loop. The caller holds the rcu read
+ * lock, so the entry stays valid even if another busy loop removed it first.
+ */
+static void io_napi_remove_entry(struct io_ring_ctx *ctx,
+				 struct io_napi_entry *e)
 {
-	struct io_napi_entry *e;
-	unsigned int i;
-
 	spin_lock(&ctx->napi_lock);
-	hash_for_each(ctx->napi_ht, i, e, node) {
-		if (time_after(jiffies, e->timeout)) {
-			list_del(&e->list);
-			hash_del_rcu(&e->node);
-			kfree_rcu(e, rcu);
-		}
+	if (!hlist_unhashed(&e->node)) {
+		hash_del_rcu(&e->node);
+		list_del_rcu(&e->list);
+		kfree_rcu(e, rcu);
 	}
 	spin_unlock(&ctx->napi_lock);
 }
 
-static inline void io_napi_remove_stale(struct io_ring_ctx *ctx, bool is_stale)
-{
-	if (is_stale)
-		__io_napi_remove_stale(ctx);
-}
-
 static inline bool io_napi_busy_loop_timeout(ktime_t start_time,
 					     ktime_t bp)
 {
@@ -136,25 +150,51 @@ static bool io_napi_busy_loop_should_end(void *data,
 	return false;
 }
 
-static bool __io_napi_do_busy_loop(struct io_ring_ctx *ctx,
+static void io_napi_account(struct io_napi_entry *e, int work)
+{
+	e->polls++;
+	if (work > 0) {
+		e->packets += work;
+		e->backoff = 0;
+	} else {
+		if (!e->backoff)
+			e->backoff = 1;
+		else
+			e->backoff = min(e->backoff * 2, NAPI_MAX_BACKOFF);
+		e->skip = e->backoff;
+	}
+}
+
+static void __io_napi_do_busy_loop(struct io_ring_ctx *ctx,
 				   void *loop_end_arg)
 {
 	struct io_napi_entry *e;
 	bool (*loop_end)(void *, unsigned long) = NULL;
-	bool is_stale = false;
+	bool backoff;
+	int work;
 
 	if (loop_end_arg)
 		loop_end = io_napi_busy_loop_should_end;
 
+	/* a single napi id is always polled, there's nothing to prefer */
+	backoff = !list_is_singular(&ctx->napi_list);
+
 	list_for_each_entry_rcu(e, &ctx->napi_list, list) {
-		napi_busy_loop_rcu(e->napi_id, loop_end, loop_end_arg,
-				   ctx->napi_prefer_busy_poll, BUSY_POLL_BUDGET);
+		if (time_after(jiffies, e->timeout)) {
+			io_napi_remove_entry(ctx, e);
+			continue;
+		}
+		if (backoff && e->skip) {
+			e->skip--;
+			e->skipped++;
+			continue;
+		}
 
-		if (time_after(jiffies, e->timeout))
-			is_stale = true;
+		work = napi_busy_loop_rcu(e->napi_id, loop_end, loop_end_arg,
+					  ctx->napi_prefer_busy_poll,
+					  BUSY_POLL_BUDGET);
+		io_napi_account(e, work);
 	}
-
-	return is_stale;
 }
 
 static void io_napi_blocking_busy_loop(struct io_ring_ctx *ctx,
@@ -162,7 +202,6 @@ static void io_napi_blocking_busy_loop(struct io_ring_ctx *ctx,
 {
 	unsigned long start_time = busy_loop_current_time();
 	void *loop_end_arg = NULL;
-	bool is_stale = false;
 
 	/* Singular lists use a different napi loop end check function and are
 	 * only executed once.
@@ -172,11 +211,9 @@ static void io_napi_blocking_busy_loop(struct io_ring_ctx *ctx,
 
 	rcu_read_lock();
 	do {
-		is_stale = __io_napi_do_busy_loop(ctx, loop_end_arg);
+		__io_napi_do_busy_loop(ctx, loop_end_arg);
 	} while (!io_napi_busy_loop_should_end(iowq, start_time) && !loop_end_arg);
 	rcu_read_unlock();
-
-	io_napi_remove_stale(ctx, is_stale);
 }
 
 /*
@@ -300,19 +337,35 @@ void __io_napi_busy_loop(struct io_ring_ctx *ctx, struct io_wait_queue *iowq)
  */
 int io_napi_sqpoll_busy_poll(struct io_ring_ctx *ctx)
 {
-	bool is_stale = false;
-
 	if (!READ_ONCE(ctx->napi_busy_poll_dt))
 		return 0;
 	if (list_empty_careful(&ctx->napi_list))
 		return 0;
 
 	rcu_read_lock();
-	is_stale = __io_napi_do_busy_loop(ctx, NULL);
+	__io_napi_do_busy_loop(ctx, NULL);
 	rcu_read_unlock();
 
-	io_napi_remove_stale(ctx, is_stale);
 	return 1;
 }
 
+/*
+ * io_napi_show_fdinfo() - show per napi id statistics
+ * @ctx: pointer to io-uring context structure
+ * @m: seq_file to print to
+ */
+void io_napi_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
+{
+	struct io_napi_entry *e;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(e, &ctx->napi_list, list) {
+		seq_printf(m, "  napi_id=%u, polls=%llu, packets=%llu, skipped=%llu, backoff=%u\n",
+			   e->napi_id, data_race(e->polls),
+			   data_race(e->packets), data_race(e->skipped),
+			   data_race(e->backoff));
+	}
+	rcu_read_unlock();
+}
+
 #endif
@@ -7,6 +7,8 @@
 #include <linux/io_uring.h>
 #include <net/busy_poll.h>
 
+struct seq_file;
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 
 void io_napi_init(struct io_ring_ctx *ctx);
@@ -20,6 +22,8 @@ void __io_napi_add(struct io_ring_ctx *ctx, struct socket *sock);
 void __io_napi_busy_loop(struct io_ring_ctx *ctx, struct io_wait_queue *iowq);
 int io_napi_sqpoll_busy_poll(struct io_ring_ctx *ctx);
 
+void io_napi_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m);
+
 static inline bool io_napi(struct io_ring_ctx *ctx)
 {
 	return !list_empty(&ctx->napi_list);
@@ -83,6 +87,10 @@ static inline int io_napi_sqpoll_busy_poll(struct io_ring_ctx *ctx)
 {
 	return 0;
 }
+static inline void io_napi_show_fdinfo(struct io_ring_ctx *ctx,
+				       struct seq_file *m)
+{
+}
 #endif /* CONFIG_NET_RX_BUSY_POLL */
 
 #endif
@@ -548,6 +548,12 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 			break;
 		ret = io_register_clone_buffers(ctx, arg);
 		break;
+	case IORING_REGISTER_SQPOLL_SCHED:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_register_sqpoll_sched(ctx, arg);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -12,6 +12,8 @@
 #include <linux/security.h>
 #include <linux/cpuset.h>
 #include <linux/io_uring.h>
+#include <linux/sched/clock.h>
+#include <uapi/linux/sched/types.h>
 
 #include <uapi/linux/io_uring.h>
 
@@ -167,23 +169,47 @@ static inline bool io_sqd_events_pending(struct io_sq_data *sqd)
 	return READ_ONCE(sqd->state);
 }
 
+/*
+ * If we're handling multiple rings, cap submit size for fairness: every pass,
+ * a ring earns IORING_SQPOLL_CAP_ENTRIES_VALUE entries per
+ * IORING_SQPOLL_WEIGHT_DEFAULT of weight. Credit a ring didn't use is kept
+ * for as long as it has entries queued, up to two passes or one entry worth,
+ * whichever is more, so that weights below the default still get to submit.
+ */
+static unsigned int io_sq_budget(struct io_ring_ctx *ctx,
+				 unsigned int to_submit)
+{
+	unsigned int quantum;
+
+	if (!to_submit) {
+		ctx->sq_credit = 0;
+		return 0;
+	}
+
+	quantum = IORING_SQPOLL_CAP_ENTRIES_VALUE * READ_ONCE(ctx->sq_weight);
+	ctx->sq_credit = min(ctx->sq_credit + quantum,
+			     max(2 * quantum, IORING_SQPOLL_WEIGHT_DEFAULT));
+	return min(to_submit, ctx->sq_credit / IORING_SQPOLL_WEIGHT_DEFAULT);
+}
+
 static int __io_sq_thread(struct io_ring_ctx *ctx, bool cap_entries)
 {
 	unsigned int to_submit;
 	int ret = 0;
 
 	to_submit = io_sqring_entries(ctx);
-	/* if we're handling multiple rings, cap submit size for fairness */
-	if (cap_entries && to_submit > IORING_SQPOLL_CAP_ENTRIES_VALUE)
-		to_submit = IORING_SQPOLL_CAP_ENTRIES_VALUE;
+	if (cap_entries)
+		to_submit = io_sq_budget(ctx, to_submit);
 
 	if (to_submit || !wq_list_empty(&ctx->iopoll_list)) {
 		const struct cred *creds = NULL;
+		u64 start;
 
 		if (ctx->sq_creds != current_cred())
 			creds = override_creds(ctx->sq_creds);
 
 		mutex_lock(&ctx->uring_lock);
+		start = local_clock();
 		if (!wq_list_empty(&ctx->iopoll_list))
 			io_do_iopoll(ctx, true);
 
@@ -194,6 +220,14 @@ static int __io_sq_thread(struct io_ring_ctx *ctx, bool cap_entries)
 		if (to_submit && likely(!percpu_ref_is_dying(&ctx->refs)) &&
 		    !(ctx->flags & IORING_SETUP_R_DISABLED))
 			ret = io_submit_sqes(ctx, to_submit);
+		if (ret > 0) {
+			ctx->sq_submitted += ret;
+			if (cap_entries)
+				ctx->sq_credit -= min_t(unsigned int,
+					ret * IORING_SQPOLL_WEIGHT_DEFAULT,
+					ctx->sq_credit);
+		}
+		ctx->sq_busy_time += local_clock() - start;
 		mutex_unlock(&ctx->uring_lock);
 
 		if (to_submit && wq_has_sleeper(&ctx->sqo_sq_wait))
@@ -450,6 +484,7 @@ __cold int io_sq_offload_create(struct io_ring_ctx *ctx,
 
 		ctx->sq_creds = get_current_cred();
 		ctx->sq_data = sqd;
+		ctx->sq_weight = IORING_SQPOLL_WEIGHT_DEFAULT;
 		ctx->sq_thread_idle = msecs_to_jiffies(p->sq_thread_idle);
 		if (!ctx->sq_thread_idle)
 			ctx->sq_thread_idle = HZ;
@@ -536,3 +571,73 @@ __cold int io_sqpoll_wq_cpu_affinity(struct io_ring_ctx *ctx,
 
 	return ret;
 }
+
+/*
+ * Store the SCHED_FIFO priority of the SQ thread, or 0, in @curr and set it
+ * to @prio, unless that is negative. The thread is parked meanwhile, so it
+ * can't exit under us.
+ */
+static __cold int io_sqpoll_set_prio(struct io_ring_ctx *ctx, __u32 *curr,
+				     int prio)
+{
+	struct sched_attr attr = {
+		.sched_policy	= prio > 0 ? SCHED_FIFO : SCHED_NORMAL,
+		.sched_priority	= max(prio, 0),
+	};
+	struct io_sq_data *sqd = ctx->sq_data;
+	int ret = -ENXIO;
+
+	io_sq_thread_park(sqd);
+	/* Don't change the priority of a dying thread */
+	if (sqd->thread) {
+		*curr = sqd->thread->policy == SCHED_FIFO ?
+			sqd->thread->rt_priority : 0;
+		ret = prio < 0 ? 0 : sched_setattr_nocheck(sqd->thread, &attr);
+	}
+	io_sq_thread_unpark(sqd);
+
+	return ret;
+}
+
+/*
+ * Called with uring_lock held. Looking at the priority parks the SQ thread,
+ * which needs the lock dropped like io_sqpoll_wq_cpu_affinity().
+ */
+__cold int io_register_sqpoll_sched(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_sqpoll_sched reg, curr = {};
+	int ret;
+
+	if (!(ctx->flags & IORING_SETUP_SQPOLL))
+		return -EINVAL;
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (memchr_inv(&reg.__resv, 0, sizeof(reg.__resv)) ||
+	    reg.flags & ~IORING_SQPOLL_SCHED_PRIO ||
+	    reg.weight > IORING_SQPOLL_WEIGHT_MAX)
+		return -EINVAL;
+
+	if (reg.flags & IORING_SQPOLL_SCHED_PRIO) {
+		if (reg.fifo_prio >= MAX_RT_PRIO)
+			return -EINVAL;
+		if (!capable(CAP_SYS_NICE))
+			return -EPERM;
+	}
+
+	mutex_unlock(&ctx->uring_lock);
+	ret = io_sqpoll_set_prio(ctx, &curr.fifo_prio,
+				 reg.flags & IORING_SQPOLL_SCHED_PRIO ?
+				 reg.fifo_prio : -1);
+	mutex_lock(&ctx->uring_lock);
+	/* A dying thread only fails setting the priority */
+	if (ret && (ret != -ENXIO || reg.flags & IORING_SQPOLL_SCHED_PRIO))
+		return ret;
+
+	curr.weight = ctx->sq_weight;
+
+	if (copy_to_user(arg, &curr, sizeof(curr)))
+		return -EFAULT;
+	if (reg.weight)
+		WRITE_ONCE(ctx->sq_weight, reg.weight);
+	return 0;
+}
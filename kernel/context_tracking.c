@@ -23,6 +23,7 @@
 #include <linux/hardirq.h>
 #include <linux/export.h>
 #include <linux/kprobes.h>
+#include <linux/vmalloc.h>
 #include <trace/events/rcu.h>
 
 
@@ -286,6 +287,10 @@ void noinstr ct_nmi_enter(void)
 		// instrumentation for the noinstr ct_kernel_enter_state()
 		instrument_atomic_write(&ct->state, sizeof(ct->state));
 
+		/* NMI handlers must not use stale kernel TLB entries either */
+		if (__ct_state() == CT_STATE_USER)
+			vmalloc_flush_deferred();
+
 		incby = 1;
 	} else if (!in_nmi()) {
 		instrumentation_begin();
@@ -623,6 +628,7 @@ void noinstr __ct_user_exit(enum ctx_state state)
 			ct_kernel_enter(true, CT_RCU_WATCHING - state);
 			if (state == CT_STATE_USER) {
 				instrumentation_begin();
+				vmalloc_flush_deferred();
 				vtime_user_exit(current);
 				trace_user_exit(0);
 				instrumentation_end();
@@ -456,6 +456,41 @@ static ssize_t strict_limit_show(struct device *dev,
 }
 static DEVICE_ATTR_RW(strict_limit);
 
+static ssize_t ra_feedback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	bool enable;
+	ssize_t ret;
+
+	ret = kstrtobool(buf, &enable);
+	if (ret < 0)
+		return ret;
+
+	if (enable && !bdi->ra_fb.enabled) {
+		bdi->ra_fb.window = bdi->ra_pages;
+		bdi->ra_fb.stamp = jiffies;
+	}
+	WRITE_ONCE(bdi->ra_fb.enabled, enable);
+
+	return count;
+}
+BDI_SHOW(ra_feedback, READ_ONCE(bdi->ra_fb.enabled))
+
+#define BDI_SHOW_RO(name, expr)						\
+static ssize_t name##_show(struct device *dev,				\
+			   struct device_attribute *attr, char *buf)	\
+{									\
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);		\
+									\
+	return sysfs_emit(buf, "%lld\n", (long long)expr);		\
+}									\
+static DEVICE_ATTR_RO(name);
+
+BDI_SHOW_RO(ra_bandwidth_kb, K(READ_ONCE(bdi->ra_fb.bandwidth)))
+BDI_SHOW_RO(ra_stall_us, READ_ONCE(bdi->ra_fb.stall_us))
+BDI_SHOW_RO(ra_window_kb, K(READ_ONCE(bdi->ra_fb.window)))
+
 static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_read_ahead_kb.attr,
 	&dev_attr_min_ratio.attr,
@@ -466,6 +501,10 @@ static struct attribute *bdi_dev_attrs[] = {
 	&dev_attr_max_bytes.attr,
 	&dev_attr_stable_pages_required.attr,
 	&dev_attr_strict_limit.attr,
+	&dev_attr_ra_feedback.attr,
+	&dev_attr_ra_bandwidth_kb.attr,
+	&dev_attr_ra_stall_us.attr,
+	&dev_attr_ra_window_kb.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(bdi_dev);
@@ -14,6 +14,9 @@
 #include <linux/compaction.h>
 #include <linux/mm_inline.h>
 #include <linux/sched/signal.h>
+#include <linux/sched/rt.h>
+#include <linux/sched/isolation.h>
+#include <linux/rmap.h>
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
@@ -24,6 +27,7 @@
 #include <linux/page_owner.h>
 #include <linux/psi.h>
 #include <linux/cpuset.h>
+#include <linux/hash.h>
 #include "internal.h"
 
 #ifdef CONFIG_COMPACTION
@@ -53,10 +57,182 @@ static inline bool is_via_compact_memory(int order)
 	return order == -1;
 }
 
+/*
+ * Migrating a page unmaps it, so the next access from any task mapping it
+ * takes a fault. Allow userspace to keep compaction away from pages mapped
+ * by tasks in the RT and deadline scheduling classes.
+ *
+ * Finding the tasks of an mm relies on mm->owner, so this only has an
+ * effect with CONFIG_MEMCG; without it the sysctl is accepted but ignored.
+ */
+static int sysctl_compact_rt_protect __read_mostly = IS_ENABLED(CONFIG_PREEMPT_RT);
+
+static bool mm_has_rt_task(struct mm_struct *mm)
+{
+#ifdef CONFIG_MEMCG
+	struct task_struct *owner, *t;
+	bool ret = false;
+
+	rcu_read_lock();
+	owner = rcu_dereference(mm->owner);
+	if (owner) {
+		for_each_thread(owner, t) {
+			if (rt_or_dl_task_policy(t)) {
+				ret = true;
+				break;
+			}
+		}
+	}
+	rcu_read_unlock();
+	return ret;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Walking the threads of an mm for every folio it maps is too expensive, so
+ * the result is cached for the duration of a compaction run. A task that
+ * changes its policy meanwhile is noticed by the next run.
+ */
+static bool mm_has_rt_task_cached(struct compact_control *cc,
+				  struct mm_struct *mm)
+{
+	unsigned int idx = hash_ptr(mm, COMPACT_RT_MM_CACHE_BITS);
+
+	if (cc->rt_mm_cache[idx].mm != mm) {
+		cc->rt_mm_cache[idx].mm = mm;
+		cc->rt_mm_cache[idx].rt = mm_has_rt_task(mm);
+	}
+
+	return cc->rt_mm_cache[idx].rt;
+}
+
+struct folio_rt_arg {
+	struct compact_control *cc;
+	bool rt;
+};
+
+static bool folio_mapped_by_rt_one(struct folio *folio,
+		struct vm_area_struct *vma, unsigned long addr, void *arg)
+{
+	struct folio_rt_arg *fra = arg;
+
+	if (!mm_has_rt_task_cached(fra->cc, vma->vm_mm))
+		return true;
+
+	fra->rt = true;
+	return false;
+}
+
+/*
+ * Whether RT protection applies to this run: most systems have no RT or
+ * deadline task with an mm at all, which is checked once per run.
+ */
+static bool compact_rt_protect(struct compact_control *cc)
+{
+	struct task_struct *g, *t;
+
+	if (!IS_ENABLED(CONFIG_MEMCG) || !READ_ONCE(sysctl_compact_rt_protect))
+		return false;
+
+	if (!cc->rt_tasks) {
+		cc->rt_tasks = -1;
+		rcu_read_lock();
+		for_each_process_thread(g, t) {
+			if (t->mm && rt_or_dl_task_policy(t)) {
+				cc->rt_tasks = 1;
+				break;
+			}
+		}
+		rcu_read_unlock();
+	}
+
+	return cc->rt_tasks > 0;
+}
+
+/*
+ * Folios of the same anon_vma or address_space are mostly mapped by the
+ * same mms, so the rmap walk result of one folio is reused for the others.
+ * Returns false if the folio has to be looked up with folio_mapped_by_rt().
+ */
+static bool folio_rt_cached(struct compact_control *cc, struct folio *folio,
+			    bool *rt)
+{
+	void *mapping = folio_raw_mapping(folio);
+	unsigned int idx;
+
+	if (!mapping) {
+		*rt = false;
+		return true;
+	}
+
+	idx = hash_ptr(mapping, COMPACT_RT_MM_CACHE_BITS);
+	if (cc->rt_map_cache[idx].mapping != mapping)
+		return false;
+
+	*rt = cc->rt_map_cache[idx].rt;
+	return true;
+}
+
+/*
+ * Returns true if @folio is mapped by an RT or deadline task, or if that
+ * cannot be determined without blocking on the rmap locks. The rmap walk
+ * may sleep, so the caller must not hold the lru_lock.
+ */
+static bool folio_mapped_by_rt(struct compact_control *cc,
+			       struct folio *folio)
+{
+	struct folio_rt_arg fra = { .cc = cc };
+	void *mapping = folio_raw_mapping(folio);
+	bool we_locked = false;
+	unsigned int idx;
+	struct rmap_walk_control rwc = {
+		.rmap_one = folio_mapped_by_rt_one,
+		.arg = &fra,
+		.anon_lock = folio_lock_anon_vma_read,
+		.try_lock = true,
+	};
+
+	if (!folio_mapped(folio) || !mapping)
+		return false;
+
+	if (!folio_test_anon(folio) || folio_test_ksm(folio)) {
+		we_locked = folio_trylock(folio);
+		if (!we_locked)
+			return true;
+	}
+
+	rmap_walk(folio, &rwc);
+
+	if (we_locked)
+		folio_unlock(folio);
+
+	if (rwc.contended)
+		return true;
+
+	idx = hash_ptr(mapping, COMPACT_RT_MM_CACHE_BITS);
+	cc->rt_map_cache[idx].mapping = mapping;
+	cc->rt_map_cache[idx].rt = fra.rt;
+	return fra.rt;
+}
+
 #else
 #define count_compact_event(item) do { } while (0)
 #define count_compact_events(item, delta) do { } while (0)
 static inline bool is_via_compact_memory(int order) { return false; }
+static inline bool compact_rt_protect(struct compact_control *cc)
+{
+	return false;
+}
+static inline bool folio_rt_cached(struct compact_control *cc,
+				   struct folio *folio, bool *rt)
+{
+	*rt = false;
+	return true;
+}
+static inline bool folio_mapped_by_rt(struct compact_control *cc,
+				      struct folio *folio) { return false; }
 #endif
 
 #if defined CONFIG_COMPACTION || defined CONFIG_CMA
@@ -1136,6 +1312,26 @@ isolate_migratepages_block(struct compact_control *cc, unsigned long low_pfn,
 		if (!(mode & ISOLATE_UNEVICTABLE) && is_unevictable)
 			goto isolate_fail_put;
 
+		/* Likewise for pages of RT tasks, see sysctl_compact_rt_protect */
+		if (!cc->alloc_contig && folio_mapped(folio) &&
+		    compact_rt_protect(cc)) {
+			bool rt;
+
+			if (!folio_rt_cached(cc, folio, &rt)) {
+				/* The rmap walk may sleep */
+				if (locked) {
+					unlock_page_lruvec_irqrestore(locked,
+								      flags);
+					locked = NULL;
+				}
+				rt = folio_mapped_by_rt(cc, folio);
+			}
+			if (rt) {
+				count_compact_event(COMPACTRTSKIPPED);
+				goto isolate_fail_put;
+			}
+		}
+
 		/*
 		 * To minimise LRU disruption, the caller can indicate with
 		 * ISOLATE_ASYNC_MIGRATE that it only wants to isolate pages
@@ -1922,6 +2118,13 @@ static int sysctl_compact_unevictable_allowed __read_mostly = CONFIG_COMPACT_UNE
  * background. It takes values in the range [0, 100].
  */
 static unsigned int __read_mostly sysctl_compaction_proactiveness = 20;
+/*
+ * Maximum time in milliseconds kcompactd may spend in one proactive
+ * compaction pass before the next pass is pushed out proportionally.
+ * 0 means no limit.
+ */
+static unsigned int __read_mostly sysctl_compaction_proactive_budget_ms =
+	IS_ENABLED(CONFIG_PREEMPT_RT) ? 10 : 0;
 static int sysctl_extfrag_threshold = 500;
 static int __read_mostly sysctl_compact_memory;
 
@@ -3148,6 +3351,55 @@ void wakeup_kcompactd(pg_data_t *pgdat, int order, int highest_zoneidx)
 	wake_up_interruptible(&pgdat->kcompactd_wait);
 }
 
+/*
+ * Bind kcompactd to the housekeeping CPUs of its node, so that isolated
+ * CPUs never have to run compaction. If the node has no online housekeeping
+ * CPU, fall back to any housekeeping CPU rather than to the isolated ones.
+ */
+static void kcompactd_set_cpus_allowed(pg_data_t *pgdat, struct task_struct *tsk)
+{
+	const struct cpumask *node_mask = cpumask_of_node(pgdat->node_id);
+	const struct cpumask *hk_mask = housekeeping_cpumask(HK_TYPE_KTHREAD);
+	cpumask_var_t mask;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL)) {
+		if (!cpumask_empty(node_mask))
+			set_cpus_allowed_ptr(tsk, node_mask);
+		return;
+	}
+
+	if (cpumask_and(mask, node_mask, hk_mask) &&
+	    cpumask_intersects(mask, cpu_online_mask))
+		set_cpus_allowed_ptr(tsk, mask);
+	else if (housekeeping_enabled(HK_TYPE_KTHREAD))
+		set_cpus_allowed_ptr(tsk, hk_mask);
+	else if (!cpumask_empty(node_mask))
+		set_cpus_allowed_ptr(tsk, node_mask);
+
+	free_cpumask_var(mask);
+}
+
+/*
+ * Returns the interval until the next proactive pass, stretched so that
+ * kcompactd spends at most sysctl_compaction_proactive_budget_ms of every
+ * default_timeout compacting.
+ */
+static long kcompactd_budget_timeout(unsigned long elapsed, long timeout,
+				     long default_timeout)
+{
+	unsigned long budget;
+
+	if (!sysctl_compaction_proactive_budget_ms)
+		return timeout;
+
+	budget = msecs_to_jiffies(sysctl_compaction_proactive_budget_ms);
+	if (elapsed <= budget)
+		return timeout;
+
+	return clamp_t(long, default_timeout * DIV_ROUND_UP(elapsed, budget),
+		       timeout, default_timeout << COMPACT_MAX_DEFER_SHIFT);
+}
+
 /*
  * The background compaction daemon, started as a kernel thread
  * from the init process.
@@ -3159,10 +3411,7 @@ static int kcompactd(void *p)
 	long default_timeout = msecs_to_jiffies(HPAGE_FRAG_CHECK_INTERVAL_MSEC);
 	long timeout = default_timeout;
 
-	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
-
-	if (!cpumask_empty(cpumask))
-		set_cpus_allowed_ptr(tsk, cpumask);
+	kcompactd_set_cpus_allowed(pgdat, tsk);
 
 	set_freezable();
 
@@ -3204,6 +3453,7 @@ static int kcompactd(void *p)
 		timeout = default_timeout;
 		if (should_proactive_compact_node(pgdat)) {
 			unsigned int prev_score, score;
+			unsigned long start = jiffies;
 
 			prev_score = fragmentation_score_node(pgdat);
 			compact_node(pgdat, true);
@@ -3215,6 +3465,9 @@ static int kcompactd(void *p)
 			if (unlikely(score >= prev_score))
 				timeout =
 				   default_timeout << COMPACT_MAX_DEFER_SHIFT;
+			timeout = kcompactd_budget_timeout(jiffies - start,
+							   timeout,
+							   default_timeout);
 		}
 		if (unlikely(pgdat->proactive_compact_trigger))
 			pgdat->proactive_compact_trigger = false;
@@ -3274,7 +3527,8 @@ static int kcompactd_cpu_online(unsigned int cpu)
 		if (cpumask_any_and(cpu_online_mask, mask) < nr_cpu_ids)
 			/* One of our CPUs online: restore mask */
 			if (pgdat->kcompactd)
-				set_cpus_allowed_ptr(pgdat->kcompactd, mask);
+				kcompactd_set_cpus_allowed(pgdat,
+							   pgdat->kcompactd);
 	}
 	return 0;
 }
@@ -3333,6 +3587,23 @@ static struct ctl_table vm_compaction[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= SYSCTL_ONE,
 	},
+	{
+		.procname	= "compact_rt_protect",
+		.data		= &sysctl_compact_rt_protect,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax_warn_RT_change,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
+	{
+		.procname	= "compaction_proactive_budget_ms",
+		.data		= &sysctl_compaction_proactive_budget_ms,
+		.maxlen		= sizeof(sysctl_compaction_proactive_budget_ms),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec_minmax,
+		.extra2		= SYSCTL_ONE_THOUSAND,
+	},
 };
 
 static int __init kcompactd_init(void)
@@ -445,6 +445,7 @@ struct damon_target *damon_new_target(void)
 	t->nr_regions = 0;
 	INIT_LIST_HEAD(&t->regions_list);
 	INIT_LIST_HEAD(&t->list);
+	xa_init(&t->pinned);
 
 	return t;
 }
@@ -470,11 +471,18 @@ void damon_free_target(struct damon_target *t)
 
 	damon_for_each_region_safe(r, next, t)
 		damon_free_region(r);
+	xa_destroy(&t->pinned);
 	kfree(t);
 }
 
-void damon_destroy_target(struct damon_target *t)
+/*
+ * Unlink and free a target. @ctx is the context @t belongs to, or NULL if
+ * it was never added to one.
+ */
+void damon_destroy_target(struct damon_target *t, struct damon_ctx *ctx)
 {
+	if (ctx && ctx->ops.cleanup_target)
+		ctx->ops.cleanup_target(t);
 	damon_del_target(t);
 	damon_free_target(t);
 }
@@ -518,13 +526,8 @@ static void damon_destroy_targets(struct damon_ctx *ctx)
 {
 	struct damon_target *t, *next_t;
 
-	if (ctx->ops.cleanup) {
-		ctx->ops.cleanup(ctx);
-		return;
-	}
-
 	damon_for_each_target_safe(t, next_t, ctx)
-		damon_destroy_target(t);
+		damon_destroy_target(t, ctx);
 }
 
 void damon_destroy_ctx(struct damon_ctx *ctx)
@@ -952,9 +955,11 @@ static int damon_commit_targets(
 			if (err)
 				return err;
 		} else {
+			struct pid *pid = dst_target->pid;
+
+			damon_destroy_target(dst_target, dst);
 			if (damon_target_has_pid(dst))
-				put_pid(dst_target->pid);
-			damon_destroy_target(dst_target);
+				put_pid(pid);
 		}
 	}
 
@@ -967,7 +972,7 @@ static int damon_commit_targets(
 		err = damon_commit_target(new_target, false,
 				src_target, damon_target_has_pid(src));
 		if (err) {
-			damon_destroy_target(new_target);
+			damon_destroy_target(new_target, NULL);
 			return err;
 		}
 		damon_add_target(dst, new_target);
@@ -465,16 +465,18 @@ static int dbgfs_set_targets(struct damon_ctx *ctx, ssize_t nr_targets,
 	struct damon_target *t, *next;
 
 	damon_for_each_target_safe(t, next, ctx) {
+		struct pid *pid = t->pid;
+
+		damon_destroy_target(t, ctx);
 		if (damon_target_has_pid(ctx))
-			put_pid(t->pid);
-		damon_destroy_target(t);
+			put_pid(pid);
 	}
 
 	for (i = 0; i < nr_targets; i++) {
 		t = damon_new_target();
 		if (!t) {
 			damon_for_each_target_safe(t, next, ctx)
-				damon_destroy_target(t);
+				damon_destroy_target(t, ctx);
 			if (damon_target_has_pid(ctx))
 				dbgfs_put_pids(pids, nr_targets);
 			return -ENOMEM;
@@ -779,8 +781,10 @@ static void dbgfs_before_terminate(struct damon_ctx *ctx)
 
 	mutex_lock(&ctx->kdamond_lock);
 	damon_for_each_target_safe(t, next, ctx) {
-		put_pid(t->pid);
-		damon_destroy_target(t);
+		struct pid *pid = t->pid;
+
+		damon_destroy_target(t, ctx);
+		put_pid(pid);
 	}
 	mutex_unlock(&ctx->kdamond_lock);
 }
@@ -1460,6 +1460,7 @@ static const char * const damon_sysfs_damos_action_strs[] = {
 	"lru_deprio",
 	"migrate_hot",
 	"migrate_cold",
+	"pin_hot",
 	"stat",
 };
 
@@ -1102,9 +1102,11 @@ static void damon_sysfs_destroy_targets(struct damon_ctx *ctx)
 	bool has_pid = damon_target_has_pid(ctx);
 
 	damon_for_each_target_safe(t, next, ctx) {
+		struct pid *pid = t->pid;
+
+		damon_destroy_target(t, ctx);
 		if (has_pid)
-			put_pid(t->pid);
-		damon_destroy_target(t);
+			put_pid(pid);
 	}
 }
 
@@ -1206,8 +1208,10 @@ static void damon_sysfs_before_terminate(struct damon_ctx *ctx)
 
 	mutex_lock(&ctx->kdamond_lock);
 	damon_for_each_target_safe(t, next, ctx) {
-		put_pid(t->pid);
-		damon_destroy_target(t);
+		struct pid *pid = t->pid;
+
+		damon_destroy_target(t, ctx);
+		put_pid(pid);
 	}
 	mutex_unlock(&ctx->kdamond_lock);
 }
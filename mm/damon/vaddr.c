@@ -15,6 +15,8 @@
 #include <linux/pagewalk.h>
 #include <linux/sched/mm.h>
 
+#include "../internal.h"
+
 #include "ops-common.h"
 
 #ifdef CONFIG_DAMON_VADDR_KUNIT_TEST
@@ -652,6 +654,335 @@ static unsigned long damos_madvise(struct damon_target *target,
 }
 #endif	/* CONFIG_ADVISE_SYSCALLS */
 
+struct damos_va_isolate_private {
+	struct list_head *folio_list;
+	int nid;
+};
+
+static void damos_va_isolate_folio(struct folio *folio,
+		struct damos_va_isolate_private *priv)
+{
+	if (!folio || folio_nid(folio) == priv->nid)
+		return;
+	if (folio_isolate_lru(folio))
+		list_add(&folio->lru, priv->folio_list);
+}
+
+static int damos_va_isolate_pmd_entry(pmd_t *pmd, unsigned long addr,
+		unsigned long next, struct mm_walk *walk)
+{
+	struct damos_va_isolate_private *priv = walk->private;
+	pte_t *start_pte, *pte;
+	pte_t ptent;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (pmd_trans_huge(pmdp_get(pmd))) {
+		pmd_t pmde;
+
+		ptl = pmd_lock(walk->mm, pmd);
+		pmde = pmdp_get(pmd);
+
+		if (!pmd_present(pmde)) {
+			spin_unlock(ptl);
+			return 0;
+		}
+
+		if (!pmd_trans_huge(pmde)) {
+			spin_unlock(ptl);
+			goto regular_page;
+		}
+		damos_va_isolate_folio(vm_normal_folio_pmd(walk->vma, addr,
+							   pmde), priv);
+		spin_unlock(ptl);
+		return 0;
+	}
+
+regular_page:
+#endif	/* CONFIG_TRANSPARENT_HUGEPAGE */
+
+	start_pte = pte = pte_offset_map_lock(walk->mm, pmd, addr, &ptl);
+	if (!pte) {
+		walk->action = ACTION_AGAIN;
+		return 0;
+	}
+	for (; addr < next; pte++, addr += PAGE_SIZE) {
+		ptent = ptep_get(pte);
+		if (!pte_present(ptent))
+			continue;
+		damos_va_isolate_folio(vm_normal_folio(walk->vma, addr, ptent),
+				       priv);
+	}
+	pte_unmap_unlock(start_pte, ptl);
+	return 0;
+}
+
+static const struct mm_walk_ops damos_va_isolate_ops = {
+	.pmd_entry = damos_va_isolate_pmd_entry,
+	.walk_lock = PGWALK_RDLOCK,
+};
+
+/*
+ * The node to pin the hot pages of @t on: &damos->target_nid if set,
+ * otherwise the node of the CPU the target task last ran on.
+ */
+static int damos_va_pin_nid(struct damon_target *t, struct damos *s)
+{
+	struct task_struct *task;
+	int nid;
+
+	if (s->target_nid != NUMA_NO_NODE)
+		return s->target_nid;
+
+	task = damon_get_task_struct(t);
+	if (!task)
+		return NUMA_NO_NODE;
+	nid = cpu_to_node(task_cpu(task));
+	put_task_struct(task);
+
+	return nid;
+}
+
+/*
+ * Regions are locked in whole chunks of DAMOS_PIN_SIZE, so that vmas are
+ * only split at chunk boundaries however the regions move, and adjacent
+ * locked chunks merge again. Only the parts of a chunk that were not
+ * locked already, by the process itself, are locked, and those parts are
+ * kept in a &struct damos_pin_chunk in &damon_target->pinned, along with
+ * the sample interval they expire at. A chunk that is not found hot again
+ * by then is unlocked after the aggregation, see damon_va_unpin_cold().
+ */
+#define DAMOS_PIN_SIZE		PMD_SIZE
+#define DAMOS_PIN_MAX_RANGES	4
+
+struct damos_pin_chunk {
+	unsigned long expiry;
+	unsigned int nr_ranges;
+	struct {
+		unsigned long start;
+		unsigned long end;
+	} ranges[DAMOS_PIN_MAX_RANGES];
+};
+
+static unsigned long damos_va_pin_expiry(struct damon_ctx *ctx,
+		struct damos *s)
+{
+	unsigned long interval = s->apply_interval_us ?
+		s->apply_interval_us : ctx->attrs.aggr_interval;
+
+	return ctx->passed_sample_intervals +
+		2 * interval / max(ctx->attrs.sample_interval, 1UL);
+}
+
+/* Record the parts of [start, end) that are not locked yet in @chunk. */
+static void damos_va_pin_ranges(struct mm_struct *mm, unsigned long start,
+		unsigned long end, struct damos_pin_chunk *chunk)
+{
+	struct vm_area_struct *vma;
+	VMA_ITERATOR(vmi, mm, start);
+
+	chunk->nr_ranges = 0;
+	for_each_vma_range(vmi, vma, end) {
+		unsigned long vstart = max(start, vma->vm_start);
+		unsigned long vend = min(end, vma->vm_end);
+		unsigned int i = chunk->nr_ranges;
+
+		if (vma->vm_flags & VM_LOCKED)
+			continue;
+		if (i && chunk->ranges[i - 1].end == vstart) {
+			chunk->ranges[i - 1].end = vend;
+			continue;
+		}
+		if (i == DAMOS_PIN_MAX_RANGES)
+			break;
+		chunk->ranges[i].start = vstart;
+		chunk->ranges[i].end = vend;
+		chunk->nr_ranges++;
+	}
+}
+
+static void damos_va_unpin_chunk(struct mm_struct *mm,
+		struct damos_pin_chunk *chunk)
+{
+	unsigned int i;
+
+	for (i = 0; i < chunk->nr_ranges; i++)
+		mlock_mm_range(mm, chunk->ranges[i].start,
+			       chunk->ranges[i].end, false);
+}
+
+static unsigned long damos_va_pin_range(struct damon_ctx *ctx,
+		struct damon_target *t, struct mm_struct *mm,
+		unsigned long start, unsigned long end, struct damos *s)
+{
+	unsigned long expiry = damos_va_pin_expiry(ctx, s);
+	struct damos_pin_chunk *chunk;
+	unsigned long addr, applied = 0;
+	unsigned int i;
+	long locked = 0;
+
+	start = ALIGN_DOWN(start, DAMOS_PIN_SIZE);
+	end = ALIGN(end, DAMOS_PIN_SIZE);
+
+	for (addr = start; addr < end; addr += DAMOS_PIN_SIZE) {
+		unsigned long idx = addr / DAMOS_PIN_SIZE;
+
+		chunk = xa_load(&t->pinned, idx);
+		if (chunk) {
+			chunk->expiry = expiry;
+			applied += DAMOS_PIN_SIZE;
+			continue;
+		}
+
+		chunk = kmalloc(sizeof(*chunk), GFP_KERNEL);
+		if (!chunk)
+			break;
+		chunk->expiry = expiry;
+		damos_va_pin_ranges(mm, addr, addr + DAMOS_PIN_SIZE, chunk);
+		if (!chunk->nr_ranges) {
+			kfree(chunk);
+			continue;
+		}
+
+		for (i = 0; i < chunk->nr_ranges; i++) {
+			locked = mlock_mm_range(mm, chunk->ranges[i].start,
+						chunk->ranges[i].end, true);
+			if (locked < 0)
+				break;
+		}
+		if (locked < 0) {
+			chunk->nr_ranges = i;
+			goto undo;
+		}
+
+		/* Untracked chunks would never be unlocked */
+		if (xa_is_err(xa_store(&t->pinned, idx, chunk, GFP_KERNEL)))
+			goto undo;
+		applied += DAMOS_PIN_SIZE;
+	}
+
+	return applied;
+
+undo:
+	damos_va_unpin_chunk(mm, chunk);
+	kfree(chunk);
+	return applied;
+}
+
+/*
+ * Unlock the chunks of @t that expired by sample interval @now, or all of
+ * them if @all.
+ */
+static void damos_va_unpin(struct damon_target *t, unsigned long now,
+		bool all)
+{
+	struct damos_pin_chunk *chunk;
+	struct mm_struct *mm;
+	bool expired = all;
+	unsigned long idx;
+
+	if (xa_empty(&t->pinned))
+		return;
+
+	xa_for_each(&t->pinned, idx, chunk) {
+		if (chunk->expiry <= now) {
+			expired = true;
+			break;
+		}
+	}
+	if (!expired)
+		return;
+
+	mm = damon_get_mm(t);
+	if (!mm) {
+		/* The process is gone, and so are its locks */
+		xa_for_each(&t->pinned, idx, chunk)
+			kfree(chunk);
+		xa_destroy(&t->pinned);
+		return;
+	}
+
+	if (all)
+		mmap_write_lock(mm);
+	else if (mmap_write_lock_killable(mm))
+		goto out;
+
+	xa_for_each(&t->pinned, idx, chunk) {
+		if (!all && chunk->expiry > now)
+			continue;
+		damos_va_unpin_chunk(mm, chunk);
+		xa_erase(&t->pinned, idx);
+		kfree(chunk);
+	}
+	mmap_write_unlock(mm);
+out:
+	mmput(mm);
+}
+
+static void damon_va_unpin_cold(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx)
+		damos_va_unpin(t, ctx->passed_sample_intervals, false);
+}
+
+static void damon_va_cleanup(struct damon_ctx *ctx)
+{
+	struct damon_target *t;
+
+	damon_for_each_target(t, ctx)
+		damos_va_unpin(t, 0, true);
+}
+
+static void damon_va_cleanup_target(struct damon_target *t)
+{
+	damos_va_unpin(t, 0, true);
+}
+
+/*
+ * Keep a hot region resident and fast: migrate it to the pinning node,
+ * collapse it to THPs and set VM_LOCKED on it. Migration and collapse are
+ * best effort; the region counts as applied once it is locked.
+ */
+static unsigned long damos_va_pin_hot(struct damon_ctx *ctx,
+		struct damon_target *t, struct damon_region *r, struct damos *s)
+{
+	unsigned long start = PAGE_ALIGN(r->ar.start);
+	unsigned long end = start + PAGE_ALIGN(damon_sz_region(r));
+	LIST_HEAD(folio_list);
+	struct damos_va_isolate_private priv = {
+		.folio_list = &folio_list,
+		.nid = damos_va_pin_nid(t, s),
+	};
+	struct mm_struct *mm;
+	unsigned long applied = 0;
+
+	mm = damon_get_mm(t);
+	if (!mm)
+		return 0;
+
+	if (priv.nid != NUMA_NO_NODE && nr_online_nodes > 1) {
+		mmap_read_lock(mm);
+		walk_page_range(mm, start, end, &damos_va_isolate_ops, &priv);
+		mmap_read_unlock(mm);
+		damon_migrate_pages(&folio_list, priv.nid);
+	}
+
+	if (IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE) &&
+	    damos_madvise(t, r, MADV_HUGEPAGE))
+		damos_madvise(t, r, MADV_COLLAPSE);
+
+	if (!mmap_write_lock_killable(mm)) {
+		applied = min(damos_va_pin_range(ctx, t, mm, start, end, s),
+			      end - start);
+		mmap_write_unlock(mm);
+	}
+	mmput(mm);
+
+	return applied;
+}
+
 static unsigned long damon_va_apply_scheme(struct damon_ctx *ctx,
 		struct damon_target *t, struct damon_region *r,
 		struct damos *scheme)
@@ -674,6 +1005,8 @@ static unsigned long damon_va_apply_scheme(struct damon_ctx *ctx,
 	case DAMOS_NOHUGEPAGE:
 		madv_action = MADV_NOHUGEPAGE;
 		break;
+	case DAMOS_PIN_HOT:
+		return damos_va_pin_hot(ctx, t, r, scheme);
 	case DAMOS_STAT:
 		return 0;
 	default:
@@ -694,6 +1027,8 @@ static int damon_va_scheme_score(struct damon_ctx *context,
 	switch (scheme->action) {
 	case DAMOS_PAGEOUT:
 		return damon_cold_score(context, r, scheme);
+	case DAMOS_PIN_HOT:
+		return damon_hot_score(context, r, scheme);
 	default:
 		break;
 	}
@@ -709,9 +1044,10 @@ static int __init damon_va_initcall(void)
 		.update = damon_va_update,
 		.prepare_access_checks = damon_va_prepare_access_checks,
 		.check_accesses = damon_va_check_accesses,
-		.reset_aggregated = NULL,
+		.reset_aggregated = damon_va_unpin_cold,
 		.target_valid = damon_va_target_valid,
-		.cleanup = NULL,
+		.cleanup = damon_va_cleanup,
+		.cleanup_target = damon_va_cleanup_target,
 		.apply_scheme = damon_va_apply_scheme,
 		.get_scheme_score = damon_va_scheme_score,
 	};
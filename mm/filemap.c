@@ -2422,12 +2422,15 @@ static int filemap_update_page(struct kiocb *iocb,
 		if (iocb->ki_flags & (IOCB_NOWAIT | IOCB_NOIO))
 			goto unlock_mapping;
 		if (!(iocb->ki_flags & IOCB_WAITQ)) {
+			u64 start = ktime_get_ns();
+
 			filemap_invalidate_unlock_shared(mapping);
 			/*
 			 * This is where we usually end up waiting for a
 			 * previously submitted readahead to finish.
 			 */
 			folio_put_wait_locked(folio, TASK_KILLABLE);
+			page_cache_ra_stall(mapping, ktime_get_ns() - start);
 			return AOP_TRUNCATED_PAGE;
 		}
 		error = __folio_lock_async(folio, iocb->ki_waitq);
@@ -5,6 +5,7 @@
 #include <linux/spinlock.h>
 
 #include <linux/mm.h>
+#include <linux/cpuset.h>
 #include <linux/memfd.h>
 #include <linux/memremap.h>
 #include <linux/pagemap.h>
@@ -16,11 +17,15 @@
 #include <linux/sched/signal.h>
 #include <linux/rwsem.h>
 #include <linux/hugetlb.h>
+#include <linux/mempolicy.h>
 #include <linux/migrate.h>
 #include <linux/mm_inline.h>
 #include <linux/pagevec.h>
+#include <linux/padata.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/isolation.h>
 #include <linux/shmem_fs.h>
+#include <linux/userfaultfd_k.h>
 
 #include <asm/mmu_context.h>
 #include <asm/tlbflush.h>
@@ -1987,23 +1992,14 @@ long faultin_page_range(struct mm_struct *mm, unsigned long start,
 	return ret;
 }
 
-/*
- * __mm_populate - populate and/or mlock pages within a range of address space.
- *
- * This is used to implement mlock() and the MAP_POPULATE / MAP_LOCKED mmap
- * flags. VMAs must be already marked with the desired vm_flags, and
- * mmap_lock must not be held.
- */
-int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
+static int populate_range(struct mm_struct *mm, unsigned long start,
+			  unsigned long end, int ignore_errors)
 {
-	struct mm_struct *mm = current->mm;
-	unsigned long end, nstart, nend;
+	unsigned long nstart, nend;
 	struct vm_area_struct *vma = NULL;
 	int locked = 0;
 	long ret = 0;
 
-	end = start + len;
-
 	for (nstart = start; nstart < end; nstart = nend) {
 		/*
 		 * We want to fault in pages for [nstart; end) address range.
@@ -2047,6 +2043,196 @@ int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
 		mmap_read_unlock(mm);
 	return ret;	/* 0 or negative error code */
 }
+
+static long faultin_range(struct mm_struct *mm, unsigned long start,
+			  unsigned long end, bool write)
+{
+	int locked = 1;
+	long pages = 0;
+
+	mmap_read_lock(mm);
+	while (start < end) {
+		pages = faultin_page_range(mm, start, end, write, &locked);
+		if (!locked) {
+			mmap_read_lock(mm);
+			locked = 1;
+		}
+		if (pages < 0)
+			break;
+		start += pages * PAGE_SIZE;
+	}
+	mmap_read_unlock(mm);
+	return pages < 0 ? pages : 0;
+}
+
+/*
+ * Large populate requests are split into PMD-aligned chunks and handed to
+ * a padata multithreaded job, so that page allocation, zeroing and page
+ * table setup scale with the number of housekeeping CPUs. Helpers run in
+ * kworkers on behalf of @task: the faults are charged to @mm's memcg, but
+ * only @task can take a fatal signal, so the helpers work through their
+ * chunks POPULATE_MT_STEP at a time and check it in between. Ranges with
+ * userfaultfd armed VMAs are populated by @task itself, a helper could
+ * wait for the userfault handler forever.
+ *
+ * The helpers allocate with their own task policy and cpuset rather than
+ * @task's, so callers with a task mempolicy or a cpuset that restricts
+ * the memory nodes populate the range themselves. VMA policies are
+ * honoured by the faults either way.
+ */
+#define POPULATE_MT_CHUNK	SZ_64M
+#define POPULATE_MT_STEP	SZ_2M
+
+struct populate_mt_job {
+	struct mm_struct *mm;
+	struct task_struct *task;
+	bool faultin;		/* faultin_page_range() rather than populate */
+	bool write;		/* faultin only */
+	int ignore_errors;	/* populate only */
+	long error;
+};
+
+static bool populate_mt_restricted(void)
+{
+#ifdef CONFIG_NUMA
+	if (current->mempolicy)
+		return true;
+#endif
+	return !nodes_subset(node_states[N_MEMORY],
+			     cpuset_current_mems_allowed);
+}
+
+bool populate_mt_worthwhile(unsigned long start, unsigned long end)
+{
+	return IS_ENABLED(CONFIG_PADATA) &&
+	       end - start >= POPULATE_MT_CHUNK * 4 &&
+	       num_online_cpus() > 1 &&
+	       !populate_mt_restricted();
+}
+
+static void populate_mt_thread(unsigned long start, unsigned long end,
+			       void *arg)
+{
+	struct populate_mt_job *pj = arg;
+	unsigned long next;
+	long ret;
+
+	for (; start < end; start = next) {
+		if (READ_ONCE(pj->error))
+			return;
+
+		if (fatal_signal_pending(pj->task)) {
+			cmpxchg(&pj->error, 0, -EINTR);
+			return;
+		}
+
+		next = min(end, start + POPULATE_MT_STEP);
+		if (pj->faultin)
+			ret = faultin_range(pj->mm, start, next, pj->write);
+		else
+			ret = populate_range(pj->mm, start, next,
+					     pj->ignore_errors);
+		if (ret < 0) {
+			cmpxchg(&pj->error, 0, ret);
+			return;
+		}
+	}
+}
+
+static bool populate_mt_uffd(struct mm_struct *mm, unsigned long start,
+			     unsigned long end)
+{
+	struct vm_area_struct *vma;
+	VMA_ITERATOR(vmi, mm, start);
+	bool ret = false;
+
+	mmap_read_lock(mm);
+	for_each_vma_range(vmi, vma, end) {
+		if (userfaultfd_armed(vma)) {
+			ret = true;
+			break;
+		}
+	}
+	mmap_read_unlock(mm);
+	return ret;
+}
+
+static long populate_mt(struct populate_mt_job *pj, unsigned long start,
+			unsigned long end)
+{
+	struct padata_mt_job job = {
+		.thread_fn   = populate_mt_thread,
+		.fn_arg      = pj,
+		.start       = start,
+		.size        = end - start,
+		.align       = PMD_SIZE,
+		.min_chunk   = POPULATE_MT_CHUNK,
+		.max_threads = cpumask_weight_and(cpu_online_mask,
+					housekeeping_cpumask(HK_TYPE_WQ)),
+	};
+
+	pj->task = current;
+	pj->error = 0;
+
+	if (populate_mt_uffd(pj->mm, start, end)) {
+		populate_mt_thread(start, end, pj);
+		return pj->error;
+	}
+
+	job.max_threads = max(job.max_threads, 1);
+	padata_do_multithreaded(&job);
+	return pj->error;
+}
+
+/*
+ * faultin_page_range_mt() - faultin_page_range() split across a padata
+ *			     multithreaded job
+ *
+ * @mm: the mm to populate page tables in
+ * @start: start address
+ * @end: end address
+ * @write: whether to prefault readable or writable
+ *
+ * mmap_lock must not be held. Returns the number of pages in the range on
+ * success, or the first error any of the helpers hit.
+ */
+long faultin_page_range_mt(struct mm_struct *mm, unsigned long start,
+			   unsigned long end, bool write)
+{
+	struct populate_mt_job pj = {
+		.mm = mm,
+		.faultin = true,
+		.write = write,
+	};
+	long ret;
+
+	ret = populate_mt(&pj, start, end);
+	return ret ? ret : (end - start) >> PAGE_SHIFT;
+}
+
+/*
+ * __mm_populate - populate and/or mlock pages within a range of address space.
+ *
+ * This is used to implement mlock() and the MAP_POPULATE / MAP_LOCKED mmap
+ * flags. VMAs must be already marked with the desired vm_flags, and
+ * mmap_lock must not be held.
+ */
+int __mm_populate(unsigned long start, unsigned long len, int ignore_errors)
+{
+	struct mm_struct *mm = current->mm;
+	unsigned long end = start + len;
+
+	if (populate_mt_worthwhile(start, end)) {
+		struct populate_mt_job pj = {
+			.mm = mm,
+			.ignore_errors = ignore_errors,
+		};
+
+		return populate_mt(&pj, start, end);
+	}
+
+	return populate_range(mm, start, end, ignore_errors);
+}
 #else /* CONFIG_MMU */
 static long __get_user_pages_locked(struct mm_struct *mm, unsigned long start,
 		unsigned long nr_pages, struct page **pages,
@@ -1921,6 +1921,8 @@ vm_fault_t do_huge_pmd_numa_page(struct vm_fault *vmf)
 					&last_cpupid);
 	if (target_nid == NUMA_NO_NODE)
 		goto out_map;
+	if (kpromoted_record_access(folio, target_nid))
+		goto out_map;
 	if (migrate_misplaced_folio_prepare(folio, vma, target_nid)) {
 		flags |= TNF_MIGRATE_FAIL;
 		goto out_map;
@@ -395,6 +395,7 @@ void unmap_page_range(struct mmu_gather *tlb,
 void page_cache_ra_order(struct readahead_control *, struct file_ra_state *,
 		unsigned int order);
 void force_page_cache_ra(struct readahead_control *, unsigned long nr);
+void page_cache_ra_stall(struct address_space *mapping, u64 ns);
 static inline void force_page_cache_readahead(struct address_space *mapping,
 		struct file *file, pgoff_t index, unsigned long nr_to_read)
 {
@@ -767,6 +768,9 @@ void memmap_init_range(unsigned long, int, unsigned long, unsigned long,
  * are moved to the end of a zone during a compaction run and the run
  * completes when free_pfn <= migrate_pfn
  */
+#define COMPACT_RT_MM_CACHE_BITS	3
+#define COMPACT_RT_MM_CACHE		(1 << COMPACT_RT_MM_CACHE_BITS)
+
 struct compact_control {
 	struct list_head freepages[NR_PAGE_ORDERS];	/* List of free pages to migrate to */
 	struct list_head migratepages;	/* List of pages being migrated */
@@ -805,6 +809,16 @@ struct compact_control {
 					 * ensure forward progress.
 					 */
 	bool alloc_contig;		/* alloc_contig_range allocation */
+	/* RT protection state of this run, see folio_mapped_by_rt() */
+	signed char rt_tasks;		/* 0 unknown, -1 none, 1 some */
+	struct {
+		struct mm_struct *mm;
+		bool rt;
+	} rt_mm_cache[COMPACT_RT_MM_CACHE];
+	struct {
+		void *mapping;		/* folio_raw_mapping() */
+		bool rt;
+	} rt_map_cache[COMPACT_RT_MM_CACHE];
 };
 
 /*
@@ -849,8 +863,15 @@ extern long populate_vma_page_range(struct vm_area_struct *vma,
 		unsigned long start, unsigned long end, int *locked);
 extern long faultin_page_range(struct mm_struct *mm, unsigned long start,
 		unsigned long end, bool write, int *locked);
+extern long faultin_page_range_mt(struct mm_struct *mm, unsigned long start,
+		unsigned long end, bool write);
+extern bool populate_mt_worthwhile(unsigned long start, unsigned long end);
 extern bool mlock_future_ok(struct mm_struct *mm, unsigned long flags,
 			       unsigned long bytes);
+extern __must_check int do_mlock(unsigned long start, size_t len,
+				 vm_flags_t flags);
+extern long mlock_mm_range(struct mm_struct *mm, unsigned long start,
+			   unsigned long end, bool lock);
 
 /*
  * NOTE: This function can't tell whether the folio is "fully mapped" in the
@@ -21,6 +21,7 @@
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
 #include <linux/ksm.h>
+#include <linux/sched/isolation.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -65,17 +66,21 @@ enum scan_result {
 #define CREATE_TRACE_POINTS
 #include <trace/events/huge_memory.h>
 
-static struct task_struct *khugepaged_thread __read_mostly;
+#define KHUGEPAGED_MAX_WORKERS 16
+
+static struct task_struct *khugepaged_threads[KHUGEPAGED_MAX_WORKERS];
 static DEFINE_MUTEX(khugepaged_mutex);
+/* number of scan workers, each owning one shard of the mm list */
+static unsigned int khugepaged_nr_workers __read_mostly = 1;
 
 /* default scan 8*512 pte (or vmas) every 30 second */
 static unsigned int khugepaged_pages_to_scan __read_mostly;
-static unsigned int khugepaged_pages_collapsed;
+static atomic_long_t khugepaged_pages_collapsed;
+static atomic_long_t khugepaged_collapse_attempts;
 static unsigned int khugepaged_full_scans;
 static unsigned int khugepaged_scan_sleep_millisecs __read_mostly = 10000;
 /* during fragmentation poll the hugepage allocator once every minute */
 static unsigned int khugepaged_alloc_sleep_millisecs __read_mostly = 60000;
-static unsigned long khugepaged_sleep_expire;
 static DEFINE_SPINLOCK(khugepaged_mm_lock);
 static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
 /*
@@ -107,9 +112,11 @@ struct collapse_control {
 /**
  * struct khugepaged_mm_slot - khugepaged information per mm that is being scanned
  * @slot: hash lookup from mm to mm_slot
+ * @shard: index of the khugepaged_scan whose list the mm_slot is on
  */
 struct khugepaged_mm_slot {
 	struct mm_slot slot;
+	unsigned int shard;
 };
 
 /**
@@ -117,20 +124,66 @@ struct khugepaged_mm_slot {
  * @mm_head: the head of the mm list to scan
  * @mm_slot: the current mm_slot we are scanning
  * @address: the next address inside that to be scanned
+ * @sleep_expire: end of the current scan_sleep_millisecs sleep
+ * @pass_start: jiffies at the start of the current pass over @mm_head
+ * @last_pass_ms: duration of the last full pass over @mm_head
+ * @pass_done: a pass over @mm_head completed since full_scans last moved
+ * @cc: collapse_control of the worker, allocated while it runs
  *
- * There is only the one khugepaged_scan instance of this cursor structure.
+ * There is one khugepaged_scan instance per khugepaged worker. The mms are
+ * sharded over the instances by hash, and each worker only ever scans its
+ * own shard, so one large mm only delays the mms of its own shard.
  */
 struct khugepaged_scan {
 	struct list_head mm_head;
 	struct khugepaged_mm_slot *mm_slot;
 	unsigned long address;
+	unsigned long sleep_expire;
+	unsigned long pass_start;
+	unsigned int last_pass_ms;
+	bool pass_done;
+	struct collapse_control *cc;
 };
 
-static struct khugepaged_scan khugepaged_scan = {
-	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
-};
+static struct khugepaged_scan khugepaged_scan[KHUGEPAGED_MAX_WORKERS];
+
+/*
+ * A full scan is counted once every worker has completed a pass over its
+ * shard. Shards without mms have nothing to scan and don't hold it up.
+ */
+static void khugepaged_pass_done(struct khugepaged_scan *scan)
+{
+	unsigned int i, nr = READ_ONCE(khugepaged_nr_workers);
+
+	lockdep_assert_held(&khugepaged_mm_lock);
+
+	scan->pass_done = true;
+	for (i = 0; i < nr; i++) {
+		if (!khugepaged_scan[i].pass_done &&
+		    !list_empty(&khugepaged_scan[i].mm_head))
+			return;
+	}
+
+	for (i = 0; i < nr; i++)
+		khugepaged_scan[i].pass_done = false;
+	khugepaged_full_scans++;
+}
+
+static unsigned int khugepaged_shard(struct mm_struct *mm)
+{
+	return hash_ptr(mm, 32) % READ_ONCE(khugepaged_nr_workers);
+}
 
 #ifdef CONFIG_SYSFS
+static void khugepaged_wake_all(void)
+{
+	int i;
+
+	for (i = 0; i < KHUGEPAGED_MAX_WORKERS; i++)
+		khugepaged_scan[i].sleep_expire = 0;
+	wake_up_interruptible(&khugepaged_wait);
+}
+
 static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
 					 struct kobj_attribute *attr,
 					 char *buf)
@@ -150,8 +203,7 @@ static ssize_t scan_sleep_millisecs_store(struct kobject *kobj,
 		return -EINVAL;
 
 	khugepaged_scan_sleep_millisecs = msecs;
-	khugepaged_sleep_expire = 0;
-	wake_up_interruptible(&khugepaged_wait);
+	khugepaged_wake_all();
 
 	return count;
 }
@@ -177,8 +229,7 @@ static ssize_t alloc_sleep_millisecs_store(struct kobject *kobj,
 		return -EINVAL;
 
 	khugepaged_alloc_sleep_millisecs = msecs;
-	khugepaged_sleep_expire = 0;
-	wake_up_interruptible(&khugepaged_wait);
+	khugepaged_wake_all();
 
 	return count;
 }
@@ -213,11 +264,22 @@ static ssize_t pages_collapsed_show(struct kobject *kobj,
 				    struct kobj_attribute *attr,
 				    char *buf)
 {
-	return sysfs_emit(buf, "%u\n", khugepaged_pages_collapsed);
+	return sysfs_emit(buf, "%ld\n",
+			  atomic_long_read(&khugepaged_pages_collapsed));
 }
 static struct kobj_attribute pages_collapsed_attr =
 	__ATTR_RO(pages_collapsed);
 
+static ssize_t collapse_attempts_show(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      char *buf)
+{
+	return sysfs_emit(buf, "%ld\n",
+			  atomic_long_read(&khugepaged_collapse_attempts));
+}
+static struct kobj_attribute collapse_attempts_attr =
+	__ATTR_RO(collapse_attempts);
+
 static ssize_t full_scans_show(struct kobject *kobj,
 			       struct kobj_attribute *attr,
 			       char *buf)
@@ -227,6 +289,64 @@ static ssize_t full_scans_show(struct kobject *kobj,
 static struct kobj_attribute full_scans_attr =
 	__ATTR_RO(full_scans);
 
+/*
+ * full_scan_ms reports how long the slowest worker took for its last full
+ * pass over its shard, i.e. how long a newly registered mm may have to wait
+ * to be looked at.
+ */
+static ssize_t full_scan_ms_show(struct kobject *kobj,
+				 struct kobj_attribute *attr,
+				 char *buf)
+{
+	unsigned int i, ms = 0;
+
+	for (i = 0; i < KHUGEPAGED_MAX_WORKERS; i++)
+		ms = max(ms, READ_ONCE(khugepaged_scan[i].last_pass_ms));
+
+	return sysfs_emit(buf, "%u\n", ms);
+}
+static struct kobj_attribute full_scan_ms_attr =
+	__ATTR_RO(full_scan_ms);
+
+static ssize_t workers_show(struct kobject *kobj,
+			    struct kobj_attribute *attr,
+			    char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(khugepaged_nr_workers));
+}
+
+static int khugepaged_reshard(void);
+
+static ssize_t workers_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	unsigned int workers, old;
+	int err;
+
+	err = kstrtouint(buf, 10, &workers);
+	if (err || !workers || workers > KHUGEPAGED_MAX_WORKERS)
+		return -EINVAL;
+
+	mutex_lock(&khugepaged_mutex);
+	old = khugepaged_nr_workers;
+	if (workers != old) {
+		WRITE_ONCE(khugepaged_nr_workers, workers);
+		err = khugepaged_reshard();
+		if (err) {
+			/* Don't leave khugepaged stopped, go back */
+			WRITE_ONCE(khugepaged_nr_workers, old);
+			if (khugepaged_reshard())
+				pr_err("khugepaged: failed to restart workers\n");
+		}
+	}
+	mutex_unlock(&khugepaged_mutex);
+
+	return err ? err : count;
+}
+static struct kobj_attribute workers_attr =
+	__ATTR_RW(workers);
+
 static ssize_t defrag_show(struct kobject *kobj,
 			   struct kobj_attribute *attr, char *buf)
 {
@@ -334,9 +454,12 @@ static struct attribute *khugepaged_attr[] = {
 	&khugepaged_max_ptes_shared_attr.attr,
 	&pages_to_scan_attr.attr,
 	&pages_collapsed_attr.attr,
+	&collapse_attempts_attr.attr,
 	&full_scans_attr.attr,
+	&full_scan_ms_attr.attr,
 	&scan_sleep_millisecs_attr.attr,
 	&alloc_sleep_millisecs_attr.attr,
+	&workers_attr.attr,
 	NULL,
 };
 
@@ -385,6 +508,11 @@ int hugepage_madvise(struct vm_area_struct *vma,
 
 int __init khugepaged_init(void)
 {
+	int i;
+
+	for (i = 0; i < KHUGEPAGED_MAX_WORKERS; i++)
+		INIT_LIST_HEAD(&khugepaged_scan[i].mm_head);
+
 	mm_slot_cache = KMEM_CACHE(khugepaged_mm_slot, 0);
 	if (!mm_slot_cache)
 		return -ENOMEM;
@@ -436,7 +564,9 @@ static bool hugepage_pmd_enabled(void)
 void __khugepaged_enter(struct mm_struct *mm)
 {
 	struct khugepaged_mm_slot *mm_slot;
+	struct khugepaged_scan *scan;
 	struct mm_slot *slot;
+	bool urgent;
 	int wakeup;
 
 	/* __khugepaged_exit() must not run from under us */
@@ -449,15 +579,26 @@ void __khugepaged_enter(struct mm_struct *mm)
 		return;
 
 	slot = &mm_slot->slot;
+	urgent = mem_cgroup_khugepaged_weight(mm) > CGROUP_WEIGHT_DFL;
 
 	spin_lock(&khugepaged_mm_lock);
 	mm_slot_insert(mm_slots_hash, mm, slot);
-	/*
-	 * Insert just behind the scanning cursor, to let the area settle
-	 * down a little.
-	 */
-	wakeup = list_empty(&khugepaged_scan.mm_head);
-	list_add_tail(&slot->mm_node, &khugepaged_scan.mm_head);
+	mm_slot->shard = khugepaged_shard(mm);
+	scan = &khugepaged_scan[mm_slot->shard];
+	wakeup = list_empty(&scan->mm_head);
+	if (urgent && scan->mm_slot) {
+		/*
+		 * mms of memcgs with a raised khugepaged weight are scanned
+		 * next, so they reach their THP coverage soon after start.
+		 */
+		list_add(&slot->mm_node, &scan->mm_slot->slot.mm_node);
+	} else {
+		/*
+		 * Insert just behind the scanning cursor, to let the area
+		 * settle down a little.
+		 */
+		list_add_tail(&slot->mm_node, &scan->mm_head);
+	}
 	spin_unlock(&khugepaged_mm_lock);
 
 	mmgrab(mm);
@@ -485,7 +626,7 @@ void __khugepaged_exit(struct mm_struct *mm)
 	spin_lock(&khugepaged_mm_lock);
 	slot = mm_slot_lookup(mm_slots_hash, mm);
 	mm_slot = mm_slot_entry(slot, struct khugepaged_mm_slot, slot);
-	if (mm_slot && khugepaged_scan.mm_slot != mm_slot) {
+	if (mm_slot && khugepaged_scan[mm_slot->shard].mm_slot != mm_slot) {
 		hash_del(&slot->hash);
 		list_del(&slot->mm_node);
 		free = 1;
@@ -843,10 +984,6 @@ static void khugepaged_alloc_sleep(void)
 	remove_wait_queue(&khugepaged_wait, &wait);
 }
 
-struct collapse_control khugepaged_collapse_control = {
-	.is_khugepaged = true,
-};
-
 static bool hpage_collapse_scan_abort(int nid, struct collapse_control *cc)
 {
 	int i;
@@ -1069,6 +1206,9 @@ static int alloc_charge_folio(struct folio **foliop, struct mm_struct *mm,
 	int node = hpage_collapse_find_target_node(cc);
 	struct folio *folio;
 
+	if (cc->is_khugepaged)
+		atomic_long_inc(&khugepaged_collapse_attempts);
+
 	folio = __folio_alloc(gfp, HPAGE_PMD_ORDER, node, &cc->alloc_nmask);
 	if (!folio) {
 		*foliop = NULL;
@@ -2330,7 +2470,8 @@ static int hpage_collapse_scan_file(struct mm_struct *mm, unsigned long addr,
 }
 #endif
 
-static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
+static unsigned int khugepaged_scan_mm_slot(struct khugepaged_scan *scan,
+					    unsigned int pages, int *result,
 					    struct collapse_control *cc)
 	__releases(&khugepaged_mm_lock)
 	__acquires(&khugepaged_mm_lock)
@@ -2340,25 +2481,35 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
 	struct mm_slot *slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
+	unsigned int weight;
 	int progress = 0;
 
 	VM_BUG_ON(!pages);
 	lockdep_assert_held(&khugepaged_mm_lock);
 	*result = SCAN_FAIL;
 
-	if (khugepaged_scan.mm_slot) {
-		mm_slot = khugepaged_scan.mm_slot;
+	if (scan->mm_slot) {
+		mm_slot = scan->mm_slot;
 		slot = &mm_slot->slot;
 	} else {
-		slot = list_entry(khugepaged_scan.mm_head.next,
+		slot = list_entry(scan->mm_head.next,
 				     struct mm_slot, mm_node);
 		mm_slot = mm_slot_entry(slot, struct khugepaged_mm_slot, slot);
-		khugepaged_scan.address = 0;
-		khugepaged_scan.mm_slot = mm_slot;
+		scan->address = 0;
+		scan->mm_slot = mm_slot;
+		if (list_is_first(&slot->mm_node, &scan->mm_head))
+			scan->pass_start = jiffies;
 	}
 	spin_unlock(&khugepaged_mm_lock);
 
 	mm = slot->mm;
+	/*
+	 * Scale the budget by the memcg's khugepaged weight: a weight of 200
+	 * gets through twice as many ptes of this mm for the same amount of
+	 * reported progress.
+	 */
+	weight = mem_cgroup_khugepaged_weight(mm);
+	pages = max(1U, mult_frac(pages, weight, CGROUP_WEIGHT_DFL));
 	/*
 	 * Don't wait for semaphore (to avoid long wait times).  Just move to
 	 * the next mm on the list.
@@ -2371,7 +2522,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
 	if (unlikely(hpage_collapse_test_exit_or_disable(mm)))
 		goto breakouterloop;
 
-	vma_iter_init(&vmi, mm, khugepaged_scan.address);
+	vma_iter_init(&vmi, mm, scan->address);
 	for_each_vma(vmi, vma) {
 		unsigned long hstart, hend;
 
@@ -2388,52 +2539,52 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
 		}
 		hstart = round_up(vma->vm_start, HPAGE_PMD_SIZE);
 		hend = round_down(vma->vm_end, HPAGE_PMD_SIZE);
-		if (khugepaged_scan.address > hend)
+		if (scan->address > hend)
 			goto skip;
-		if (khugepaged_scan.address < hstart)
-			khugepaged_scan.address = hstart;
-		VM_BUG_ON(khugepaged_scan.address & ~HPAGE_PMD_MASK);
+		if (scan->address < hstart)
+			scan->address = hstart;
+		VM_BUG_ON(scan->address & ~HPAGE_PMD_MASK);
 
-		while (khugepaged_scan.address < hend) {
+		while (scan->address < hend) {
 			bool mmap_locked = true;
 
 			cond_resched();
 			if (unlikely(hpage_collapse_test_exit_or_disable(mm)))
 				goto breakouterloop;
 
-			VM_BUG_ON(khugepaged_scan.address < hstart ||
-				  khugepaged_scan.address + HPAGE_PMD_SIZE >
+			VM_BUG_ON(scan->address < hstart ||
+				  scan->address + HPAGE_PMD_SIZE >
 				  hend);
 			if (IS_ENABLED(CONFIG_SHMEM) && vma->vm_file) {
 				struct file *file = get_file(vma->vm_file);
 				pgoff_t pgoff = linear_page_index(vma,
-						khugepaged_scan.address);
+						scan->address);
 
 				mmap_read_unlock(mm);
 				mmap_locked = false;
 				*result = hpage_collapse_scan_file(mm,
-					khugepaged_scan.address, file, pgoff, cc);
+					scan->address, file, pgoff, cc);
 				fput(file);
 				if (*result == SCAN_PTE_MAPPED_HUGEPAGE) {
 					mmap_read_lock(mm);
 					if (hpage_collapse_test_exit_or_disable(mm))
 						goto breakouterloop;
 					*result = collapse_pte_mapped_thp(mm,
-						khugepaged_scan.address, false);
+						scan->address, false);
 					if (*result == SCAN_PMD_MAPPED)
 						*result = SCAN_SUCCEED;
 					mmap_read_unlock(mm);
 				}
 			} else {
 				*result = hpage_collapse_scan_pmd(mm, vma,
-					khugepaged_scan.address, &mmap_locked, cc);
+					scan->address, &mmap_locked, cc);
 			}
 
 			if (*result == SCAN_SUCCEED)
-				++khugepaged_pages_collapsed;
+				atomic_long_inc(&khugepaged_pages_collapsed);
 
 			/* move to next address */
-			khugepaged_scan.address += HPAGE_PMD_SIZE;
+			scan->address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
 			if (!mmap_locked)
 				/*
@@ -2453,7 +2604,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
 breakouterloop_mmap_lock:
 
 	spin_lock(&khugepaged_mm_lock);
-	VM_BUG_ON(khugepaged_scan.mm_slot != mm_slot);
+	VM_BUG_ON(scan->mm_slot != mm_slot);
 	/*
 	 * Release the current mm_slot if this mm is about to die, or
 	 * if we scanned all vmas of this mm.
@@ -2464,35 +2615,38 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages, int *result,
 		 * khugepaged runs here, khugepaged_exit will find
 		 * mm_slot not pointing to the exiting mm.
 		 */
-		if (slot->mm_node.next != &khugepaged_scan.mm_head) {
+		if (slot->mm_node.next != &scan->mm_head) {
 			slot = list_entry(slot->mm_node.next,
 					  struct mm_slot, mm_node);
-			khugepaged_scan.mm_slot =
+			scan->mm_slot =
 				mm_slot_entry(slot, struct khugepaged_mm_slot, slot);
-			khugepaged_scan.address = 0;
+			scan->address = 0;
 		} else {
-			khugepaged_scan.mm_slot = NULL;
-			khugepaged_full_scans++;
+			scan->mm_slot = NULL;
+			khugepaged_pass_done(scan);
+			WRITE_ONCE(scan->last_pass_ms,
+				   jiffies_to_msecs(jiffies - scan->pass_start));
 		}
 
 		collect_mm_slot(mm_slot);
 	}
 
-	return progress;
+	return DIV_ROUND_UP((unsigned long)progress * CGROUP_WEIGHT_DFL, weight);
 }
 
-static int khugepaged_has_work(void)
+static int khugepaged_has_work(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) && hugepage_pmd_enabled();
+	return !list_empty(&scan->mm_head) && hugepage_pmd_enabled();
 }
 
-static int khugepaged_wait_event(void)
+static int khugepaged_wait_event(struct khugepaged_scan *scan)
 {
-	return !list_empty(&khugepaged_scan.mm_head) ||
+	return !list_empty(&scan->mm_head) ||
 		kthread_should_stop();
 }
 
-static void khugepaged_do_scan(struct collapse_control *cc)
+static void khugepaged_do_scan(struct khugepaged_scan *scan,
+			       struct collapse_control *cc)
 {
 	unsigned int progress = 0, pass_through_head = 0;
 	unsigned int pages = READ_ONCE(khugepaged_pages_to_scan);
@@ -2508,11 +2662,12 @@ static void khugepaged_do_scan(struct collapse_control *cc)
 			break;
 
 		spin_lock(&khugepaged_mm_lock);
-		if (!khugepaged_scan.mm_slot)
+		if (!scan->mm_slot)
 			pass_through_head++;
-		if (khugepaged_has_work() &&
+		if (khugepaged_has_work(scan) &&
 		    pass_through_head < 2)
-			progress += khugepaged_scan_mm_slot(pages - progress,
+			progress += khugepaged_scan_mm_slot(scan,
+							    pages - progress,
 							    &result, cc);
 		else
 			progress = pages;
@@ -2534,53 +2689,163 @@ static void khugepaged_do_scan(struct collapse_control *cc)
 	}
 }
 
-static bool khugepaged_should_wakeup(void)
+static bool khugepaged_should_wakeup(struct khugepaged_scan *scan)
 {
 	return kthread_should_stop() ||
-	       time_after_eq(jiffies, khugepaged_sleep_expire);
+	       time_after_eq(jiffies, scan->sleep_expire);
 }
 
-static void khugepaged_wait_work(void)
+static void khugepaged_wait_work(struct khugepaged_scan *scan)
 {
-	if (khugepaged_has_work()) {
+	if (khugepaged_has_work(scan)) {
 		const unsigned long scan_sleep_jiffies =
 			msecs_to_jiffies(khugepaged_scan_sleep_millisecs);
 
 		if (!scan_sleep_jiffies)
 			return;
 
-		khugepaged_sleep_expire = jiffies + scan_sleep_jiffies;
+		scan->sleep_expire = jiffies + scan_sleep_jiffies;
 		wait_event_freezable_timeout(khugepaged_wait,
-					     khugepaged_should_wakeup(),
+					     khugepaged_should_wakeup(scan),
 					     scan_sleep_jiffies);
 		return;
 	}
 
 	if (hugepage_pmd_enabled())
-		wait_event_freezable(khugepaged_wait, khugepaged_wait_event());
+		wait_event_freezable(khugepaged_wait,
+				     khugepaged_wait_event(scan));
 }
 
-static int khugepaged(void *none)
+static int khugepaged(void *data)
 {
+	struct khugepaged_scan *scan = data;
 	struct khugepaged_mm_slot *mm_slot;
 
 	set_freezable();
 	set_user_nice(current, MAX_NICE);
 
 	while (!kthread_should_stop()) {
-		khugepaged_do_scan(&khugepaged_collapse_control);
-		khugepaged_wait_work();
+		khugepaged_do_scan(scan, scan->cc);
+		khugepaged_wait_work(scan);
 	}
 
 	spin_lock(&khugepaged_mm_lock);
-	mm_slot = khugepaged_scan.mm_slot;
-	khugepaged_scan.mm_slot = NULL;
+	mm_slot = scan->mm_slot;
+	scan->mm_slot = NULL;
 	if (mm_slot)
 		collect_mm_slot(mm_slot);
 	spin_unlock(&khugepaged_mm_lock);
 	return 0;
 }
 
+static bool khugepaged_running(void)
+{
+	return khugepaged_threads[0] != NULL;
+}
+
+static void khugepaged_stop_workers(void)
+{
+	int i;
+
+	for (i = 0; i < KHUGEPAGED_MAX_WORKERS; i++) {
+		if (!khugepaged_threads[i])
+			continue;
+		kthread_stop(khugepaged_threads[i]);
+		khugepaged_threads[i] = NULL;
+		kfree(khugepaged_scan[i].cc);
+		khugepaged_scan[i].cc = NULL;
+	}
+}
+
+/*
+ * Start the first khugepaged_nr_workers workers. They are kept on the
+ * housekeeping CPUs, so that isolated CPUs never see khugepaged, also
+ * not after a change of the isolation or of the worker count.
+ */
+static int khugepaged_start_workers(void)
+{
+	struct khugepaged_scan *scan;
+	struct task_struct *thread;
+	int i;
+
+	for (i = 0; i < khugepaged_nr_workers; i++) {
+		if (khugepaged_threads[i])
+			continue;
+
+		scan = &khugepaged_scan[i];
+		scan->cc = kzalloc(sizeof(*scan->cc), GFP_KERNEL);
+		if (!scan->cc) {
+			khugepaged_stop_workers();
+			return -ENOMEM;
+		}
+		scan->cc->is_khugepaged = true;
+
+		if (i)
+			thread = kthread_create(khugepaged, scan,
+						"khugepaged/%d", i);
+		else
+			thread = kthread_create(khugepaged, scan, "khugepaged");
+		if (IS_ERR(thread)) {
+			pr_err("khugepaged: kthread_create(khugepaged) failed\n");
+			kfree(scan->cc);
+			scan->cc = NULL;
+			khugepaged_stop_workers();
+			return PTR_ERR(thread);
+		}
+		set_cpus_allowed_ptr(thread,
+				     housekeeping_cpumask(HK_TYPE_KTHREAD));
+		khugepaged_threads[i] = thread;
+		wake_up_process(thread);
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_SYSFS
+/*
+ * Move every mm_slot to the shard of its mm under the current worker
+ * count. The workers are stopped meanwhile, so that no cursor points into
+ * a list that changes under it. Returns an error if they were running and
+ * could not be restarted.
+ */
+static int khugepaged_reshard(void)
+{
+	bool running = khugepaged_running();
+	LIST_HEAD(all);
+	struct mm_slot *slot, *next;
+	int i, err;
+
+	lockdep_assert_held(&khugepaged_mutex);
+
+	khugepaged_stop_workers();
+
+	spin_lock(&khugepaged_mm_lock);
+	for (i = 0; i < KHUGEPAGED_MAX_WORKERS; i++) {
+		VM_BUG_ON(khugepaged_scan[i].mm_slot);
+		list_splice_tail_init(&khugepaged_scan[i].mm_head, &all);
+		khugepaged_scan[i].last_pass_ms = 0;
+		khugepaged_scan[i].pass_done = false;
+	}
+	list_for_each_entry_safe(slot, next, &all, mm_node) {
+		struct khugepaged_mm_slot *mm_slot;
+
+		mm_slot = mm_slot_entry(slot, struct khugepaged_mm_slot, slot);
+		mm_slot->shard = khugepaged_shard(slot->mm);
+		list_move_tail(&slot->mm_node,
+			       &khugepaged_scan[mm_slot->shard].mm_head);
+	}
+	spin_unlock(&khugepaged_mm_lock);
+
+	if (!running)
+		return 0;
+
+	err = khugepaged_start_workers();
+	if (!err)
+		wake_up_interruptible(&khugepaged_wait);
+	return err;
+}
+#endif
+
 static void set_recommended_min_free_kbytes(void)
 {
 	struct zone *zone;
@@ -2638,21 +2903,13 @@ int start_stop_khugepaged(void)
 
 	mutex_lock(&khugepaged_mutex);
 	if (hugepage_pmd_enabled()) {
-		if (!khugepaged_thread)
-			khugepaged_thread = kthread_run(khugepaged, NULL,
-							"khugepaged");
-		if (IS_ERR(khugepaged_thread)) {
-			pr_err("khugepaged: kthread_run(khugepaged) failed\n");
-			err = PTR_ERR(khugepaged_thread);
-			khugepaged_thread = NULL;
+		err = khugepaged_start_workers();
+		if (err)
 			goto fail;
-		}
 
-		if (!list_empty(&khugepaged_scan.mm_head))
-			wake_up_interruptible(&khugepaged_wait);
-	} else if (khugepaged_thread) {
-		kthread_stop(khugepaged_thread);
-		khugepaged_thread = NULL;
+		wake_up_interruptible(&khugepaged_wait);
+	} else {
+		khugepaged_stop_workers();
 	}
 	set_recommended_min_free_kbytes();
 fail:
@@ -2663,7 +2920,7 @@ int start_stop_khugepaged(void)
 void khugepaged_min_free_kbytes_update(void)
 {
 	mutex_lock(&khugepaged_mutex);
-	if (hugepage_pmd_enabled() && khugepaged_thread)
+	if (hugepage_pmd_enabled() && khugepaged_running())
 		set_recommended_min_free_kbytes();
 	mutex_unlock(&khugepaged_mutex);
 }
@@ -0,0 +1,397 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Asynchronous promotion of hot folios from slower memory tiers.
+ *
+ * With kpromoted enabled, NUMA hinting faults and DAMON report accesses to
+ * folios on lower tiers through kpromoted_record_access() instead of
+ * migrating them synchronously. The samples are queued per destination
+ * node, and a kpromoted thread per node migrates them in batches, at most
+ * bandwidth_mb megabytes per second.
+ *
+ * The threads run on housekeeping CPUs, so neither the faulting task nor
+ * an isolated CPU pays for the migration.
+ */
+
+#define pr_fmt(fmt) "kpromoted: " fmt
+
+#include <linux/freezer.h>
+#include <linux/kfifo.h>
+#include <linux/kobject.h>
+#include <linux/kthread.h>
+#include <linux/memory_hotplug.h>
+#include <linux/memory-tiers.h>
+#include <linux/migrate.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sysfs.h>
+#include <linux/timekeeping.h>
+
+#include "internal.h"
+
+#define KPROMOTED_QUEUE_LEN	4096
+#define KPROMOTED_CHUNK		32
+#define KPROMOTED_INTERVAL_MS	100
+
+struct kpromoted_sample {
+	unsigned long pfn;
+	u64 stamp;
+};
+
+struct kpromoted_node {
+	int nid;
+	spinlock_t lock;
+	DECLARE_KFIFO(queue, struct kpromoted_sample, KPROMOTED_QUEUE_LEN);
+	wait_queue_head_t wait;
+	struct task_struct *task;
+	/* bandwidth token bucket, in pages */
+	unsigned long tokens;
+	unsigned long refill_time;
+	/* queued and dropped are protected by lock, the rest by the thread */
+	struct kpromoted_stats stats;
+};
+
+static struct kpromoted_node *kpromoted_nodes[MAX_NUMNODES];
+static DEFINE_MUTEX(kpromoted_mutex);
+static DEFINE_STATIC_KEY_FALSE(kpromoted_key);
+
+/* per node, 0 means unlimited */
+static unsigned int kpromoted_bandwidth_mb __read_mostly = 256;
+static unsigned int kpromoted_batch __read_mostly = 512;
+
+/*
+ * Queue an access to @folio for promotion to @nid. Returns true if the
+ * sample was taken over by kpromoted, in which case the caller must not
+ * migrate @folio itself. If the queue is full, or @folio is one that
+ * kpromoted_isolate() would refuse, false is returned and the caller
+ * migrates @folio inline as it would without kpromoted.
+ */
+bool kpromoted_record_access(struct folio *folio, int nid)
+{
+	struct kpromoted_sample sample;
+	struct kpromoted_node *kn;
+	bool queued, wake;
+
+	if (!static_branch_unlikely(&kpromoted_key))
+		return false;
+	if (nid == NUMA_NO_NODE || !node_is_toptier(nid) ||
+	    node_is_toptier(folio_nid(folio)))
+		return false;
+	kn = READ_ONCE(kpromoted_nodes[nid]);
+	if (!kn)
+		return false;
+
+	/*
+	 * Without a vma, migrate_misplaced_folio_prepare() rejects shared
+	 * and dirty file folios, but the caller may be able to migrate them.
+	 */
+	if (folio_is_file_lru(folio) &&
+	    (folio_likely_mapped_shared(folio) || folio_test_dirty(folio)))
+		return false;
+
+	sample.pfn = folio_pfn(folio);
+	sample.stamp = ktime_get_mono_fast_ns();
+
+	spin_lock(&kn->lock);
+	queued = kfifo_put(&kn->queue, sample);
+	if (queued)
+		kn->stats.queued++;
+	else
+		kn->stats.dropped++;
+	wake = kfifo_len(&kn->queue) >= READ_ONCE(kpromoted_batch);
+	spin_unlock(&kn->lock);
+
+	if (wake)
+		wake_up_interruptible(&kn->wait);
+	return queued;
+}
+
+/* Add the statistics of node @nid to @stats. */
+void kpromoted_read_stats(int nid, struct kpromoted_stats *stats)
+{
+	struct kpromoted_node *kn = READ_ONCE(kpromoted_nodes[nid]);
+	int i;
+
+	if (!kn)
+		return;
+
+	stats->queued += data_race(kn->stats.queued);
+	stats->dropped += data_race(kn->stats.dropped);
+	stats->promoted += data_race(kn->stats.promoted);
+	stats->failed += data_race(kn->stats.failed);
+	stats->throttled += data_race(kn->stats.throttled);
+	for (i = 0; i < KPROMOTED_NR_LAT_BUCKETS; i++)
+		stats->latency[i] += data_race(kn->stats.latency[i]);
+}
+
+static unsigned long kpromoted_refill(struct kpromoted_node *kn)
+{
+	unsigned int mb = READ_ONCE(kpromoted_bandwidth_mb);
+	unsigned long now = jiffies;
+	unsigned long elapsed, max;
+
+	if (!mb)
+		return ULONG_MAX;
+
+	/* allow bursts of up to one second worth of bandwidth */
+	max = (unsigned long)mb << (20 - PAGE_SHIFT);
+	elapsed = min_t(unsigned long, jiffies_to_msecs(now - kn->refill_time),
+			MSEC_PER_SEC);
+	kn->tokens = min(max, kn->tokens + max * elapsed / MSEC_PER_SEC);
+	kn->refill_time = now;
+
+	return kn->tokens;
+}
+
+/*
+ * Isolate the folio at @pfn for promotion to @nid, if it is still on an
+ * LRU list of a lower tier.
+ */
+static struct folio *kpromoted_isolate(unsigned long pfn, int nid)
+{
+	struct page *page = pfn_to_online_page(pfn);
+	struct folio *folio;
+	int ret;
+
+	if (!page)
+		return NULL;
+
+	folio = page_folio(page);
+	if (!folio_test_lru(folio) || !folio_try_get(folio))
+		return NULL;
+
+	if (unlikely(page_folio(page) != folio) ||
+	    node_is_toptier(folio_nid(folio))) {
+		folio_put(folio);
+		return NULL;
+	}
+
+	ret = migrate_misplaced_folio_prepare(folio, NULL, nid);
+	/* on success, the isolation holds its own reference */
+	folio_put(folio);
+
+	return ret ? NULL : folio;
+}
+
+static void kpromoted_account_latency(struct kpromoted_node *kn,
+				      u64 *stamps, unsigned int nr)
+{
+	u64 now = ktime_get_mono_fast_ns();
+	unsigned int i, bucket;
+
+	for (i = 0; i < nr; i++) {
+		u64 us = div_u64(now - stamps[i], NSEC_PER_USEC);
+
+		bucket = us ? ilog2(us) : 0;
+		bucket = min(bucket, KPROMOTED_NR_LAT_BUCKETS - 1);
+		kn->stats.latency[bucket]++;
+	}
+}
+
+static void kpromoted_do_work(struct kpromoted_node *kn)
+{
+	unsigned long tokens = kpromoted_refill(kn);
+	unsigned long budget = min_t(unsigned long, tokens,
+				     READ_ONCE(kpromoted_batch));
+	unsigned long used = 0;
+	bool empty = false;
+
+	while (!empty && used < budget) {
+		u64 stamps[KPROMOTED_CHUNK];
+		unsigned int nr = 0, nr_succeeded;
+		unsigned long nr_pages = 0;
+		LIST_HEAD(folios);
+
+		while (nr < KPROMOTED_CHUNK && used + nr_pages < budget) {
+			struct kpromoted_sample sample;
+			struct folio *folio;
+
+			spin_lock(&kn->lock);
+			empty = !kfifo_get(&kn->queue, &sample);
+			spin_unlock(&kn->lock);
+			if (empty)
+				break;
+
+			folio = kpromoted_isolate(sample.pfn, kn->nid);
+			if (!folio)
+				continue;
+
+			list_add(&folio->lru, &folios);
+			nr_pages += folio_nr_pages(folio);
+			stamps[nr++] = sample.stamp;
+		}
+
+		if (nr) {
+			nr_succeeded = migrate_misplaced_folio_list(&folios,
+								    kn->nid);
+			kn->stats.promoted += nr_succeeded;
+			kn->stats.failed += nr_pages - nr_succeeded;
+			kpromoted_account_latency(kn, stamps, nr);
+			used += nr_pages;
+		}
+		cond_resched();
+	}
+
+	if (tokens != ULONG_MAX) {
+		kn->tokens -= min(used, kn->tokens);
+		if (used >= tokens && !kfifo_is_empty(&kn->queue))
+			kn->stats.throttled++;
+	}
+}
+
+static int kpromoted(void *data)
+{
+	struct kpromoted_node *kn = data;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable_timeout(kn->wait, kthread_should_stop() ||
+				kfifo_len(&kn->queue) >= READ_ONCE(kpromoted_batch),
+				msecs_to_jiffies(KPROMOTED_INTERVAL_MS));
+		kpromoted_do_work(kn);
+	}
+
+	return 0;
+}
+
+/*
+ * Create the queues and threads for all memory nodes that don't have
+ * them yet. They are never torn down: disabling kpromoted only stops new
+ * samples from being queued.
+ */
+static int kpromoted_start(void)
+{
+	struct kpromoted_node *kn;
+	int nid, err = 0;
+
+	mutex_lock(&kpromoted_mutex);
+	for_each_node_state(nid, N_MEMORY) {
+		if (kpromoted_nodes[nid])
+			continue;
+
+		kn = kvzalloc_node(sizeof(*kn), GFP_KERNEL, nid);
+		if (!kn) {
+			err = -ENOMEM;
+			break;
+		}
+		kn->nid = nid;
+		spin_lock_init(&kn->lock);
+		INIT_KFIFO(kn->queue);
+		init_waitqueue_head(&kn->wait);
+		kn->refill_time = jiffies;
+
+		kn->task = kthread_create_on_node(kpromoted, kn, nid,
+						  "kpromoted%d", nid);
+		if (IS_ERR(kn->task)) {
+			err = PTR_ERR(kn->task);
+			kvfree(kn);
+			break;
+		}
+		WRITE_ONCE(kpromoted_nodes[nid], kn);
+		wake_up_process(kn->task);
+	}
+	if (!err)
+		static_branch_enable(&kpromoted_key);
+	mutex_unlock(&kpromoted_mutex);
+
+	return err;
+}
+
+static ssize_t enabled_show(struct kobject *kobj,
+			    struct kobj_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%d\n",
+			  static_branch_unlikely(&kpromoted_key));
+}
+
+static ssize_t enabled_store(struct kobject *kobj,
+			     struct kobj_attribute *attr,
+			     const char *buf, size_t count)
+{
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	if (enable) {
+		err = kpromoted_start();
+		if (err)
+			return err;
+	} else {
+		static_branch_disable(&kpromoted_key);
+	}
+
+	return count;
+}
+static struct kobj_attribute enabled_attr = __ATTR_RW(enabled);
+
+static ssize_t bandwidth_mb_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(kpromoted_bandwidth_mb));
+}
+
+static ssize_t bandwidth_mb_store(struct kobject *kobj,
+				  struct kobj_attribute *attr,
+				  const char *buf, size_t count)
+{
+	unsigned int mb;
+	int err;
+
+	err = kstrtouint(buf, 10, &mb);
+	if (err)
+		return err;
+
+	WRITE_ONCE(kpromoted_bandwidth_mb, mb);
+	return count;
+}
+static struct kobj_attribute bandwidth_mb_attr = __ATTR_RW(bandwidth_mb);
+
+static ssize_t batch_show(struct kobject *kobj,
+			  struct kobj_attribute *attr, char *buf)
+{
+	return sysfs_emit(buf, "%u\n", READ_ONCE(kpromoted_batch));
+}
+
+static ssize_t batch_store(struct kobject *kobj,
+			   struct kobj_attribute *attr,
+			   const char *buf, size_t count)
+{
+	unsigned int batch;
+	int err;
+
+	err = kstrtouint(buf, 10, &batch);
+	if (err)
+		return err;
+	if (!batch || batch > KPROMOTED_QUEUE_LEN)
+		return -EINVAL;
+
+	WRITE_ONCE(kpromoted_batch, batch);
+	return count;
+}
+static struct kobj_attribute batch_attr = __ATTR_RW(batch);
+
+static struct attribute *kpromoted_attrs[] = {
+	&enabled_attr.attr,
+	&bandwidth_mb_attr.attr,
+	&batch_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group kpromoted_attr_group = {
+	.attrs = kpromoted_attrs,
+	.name = "kpromoted",
+};
+
+static int __init kpromoted_init_sysfs(void)
+{
+	int err;
+
+	err = sysfs_create_group(mm_kobj, &kpromoted_attr_group);
+	if (err)
+		pr_err("failed to register kpromoted group\n");
+	return err;
+}
+late_initcall(kpromoted_init_sysfs);
@@ -940,7 +940,14 @@ static long madvise_populate(struct mm_struct *mm, unsigned long start,
 
 	while (start < end) {
 		/* Populate (prefault) page tables readable/writable. */
-		pages = faultin_page_range(mm, start, end, write, &locked);
+		if (populate_mt_worthwhile(start, end)) {
+			mmap_read_unlock(mm);
+			pages = faultin_page_range_mt(mm, start, end, write);
+			mmap_read_lock(mm);
+		} else {
+			pages = faultin_page_range(mm, start, end, write,
+						   &locked);
+		}
 		if (!locked) {
 			mmap_read_lock(mm);
 			locked = 1;
@@ -1184,6 +1191,7 @@ madvise_behavior_valid(int behavior)
 	case MADV_PAGEOUT:
 	case MADV_POPULATE_READ:
 	case MADV_POPULATE_WRITE:
+	case MADV_POPULATE_LOCKED:
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
@@ -1215,6 +1223,7 @@ static bool process_madvise_behavior_valid(int behavior)
 	case MADV_PAGEOUT:
 	case MADV_WILLNEED:
 	case MADV_COLLAPSE:
+	case MADV_POPULATE_LOCKED:
 		return true;
 	default:
 		return false;
@@ -1288,6 +1297,105 @@ int madvise_walk_vmas(struct mm_struct *mm, unsigned long start,
 	return unmapped_error;
 }
 
+/*
+ * Huge pages are best effort for MADV_POPULATE_LOCKED: only anonymous
+ * vmas are considered, and failures other than a fatal signal are ignored.
+ */
+static int madvise_populate_thp(struct vm_area_struct *vma,
+				struct vm_area_struct **prev,
+				unsigned long start, unsigned long end,
+				unsigned long behavior)
+{
+	int error;
+
+	*prev = vma;
+	if (!vma_is_anonymous(vma))
+		return 0;
+
+	error = madvise_vma_behavior(vma, prev, start, end, behavior);
+	return error == -EINTR ? error : 0;
+}
+
+/*
+ * MADV_POPULATE_LOCKED: mlock the range and fault it in, then collapse
+ * anonymous memory in it to THPs where possible. MADV_COLLAPSE does not
+ * depend on VM_HUGEPAGE, so the THP policy of the vmas is left as it is.
+ * Page tables are allocated as part of the faults, so once this returns
+ * the range takes no faults until it is munlocked.
+ */
+static long madvise_populate_locked(struct mm_struct *mm, unsigned long start,
+				    unsigned long end)
+{
+	int error;
+
+	/* VM_LOCKED is charged to, and populated by, the calling task */
+	if (mm != current->mm)
+		return -EINVAL;
+
+	start = untagged_addr(start);
+	end = untagged_addr(end);
+
+	error = do_mlock(start, end - start, VM_LOCKED);
+	if (error || !IS_ENABLED(CONFIG_TRANSPARENT_HUGEPAGE))
+		return error;
+
+	if (mmap_read_lock_killable(mm))
+		return -EINTR;
+	error = madvise_walk_vmas(mm, start, end, MADV_COLLAPSE,
+				  madvise_populate_thp);
+	mmap_read_unlock(mm);
+
+	return error == -EINTR ? error : 0;
+}
+
+/*
+ * MADV_DONTNEED within a single vma only needs that vma to stay stable, the
+ * same as a page fault does, so try to do it under the per-VMA lock rather
+ * than mmap_lock. Returns false if the caller has to take mmap_lock.
+ */
+static bool madvise_vma_lock(struct mm_struct *mm, unsigned long start,
+			     size_t len, int behavior, int *error)
+{
+#ifdef CONFIG_PER_VMA_LOCK
+	struct vm_area_struct *vma, *prev;
+	unsigned long end;
+
+	if (behavior != MADV_DONTNEED && behavior != MADV_DONTNEED_LOCKED)
+		return false;
+
+	/* untagged_addr_remote() needs mmap_lock */
+	if (mm != current->mm)
+		return false;
+
+	start = untagged_addr(start);
+	end = start + len;
+
+	vma = lock_vma_under_rcu(mm, start);
+	if (!vma)
+		return false;
+
+	/*
+	 * userfaultfd_remove() drops mmap_lock, and hugetlb may round the
+	 * range; leave both to the mmap_lock path. So are vmas that can be
+	 * PUD mapped (DAX, huge pfnmaps) or asked for huge pages: a partial
+	 * zap splits the PUD, which asserts mmap_lock is held.
+	 */
+	if (end > vma->vm_end || is_vm_hugetlb_page(vma) ||
+	    userfaultfd_armed(vma) || vma_is_dax(vma) ||
+	    (vma->vm_flags & (VM_HUGEPAGE | VM_PFNMAP | VM_IO))) {
+		vma_end_read(vma);
+		return false;
+	}
+
+	*error = madvise_vma_behavior(vma, &prev, start, end, behavior);
+	vma_end_read(vma);
+	count_vm_vma_lock_event(VMA_LOCK_MADVISE);
+	return true;
+#else
+	return false;
+#endif
+}
+
 #ifdef CONFIG_ANON_VMA_NAME
 static int madvise_vma_anon_name(struct vm_area_struct *vma,
 				 struct vm_area_struct **prev,
@@ -1394,6 +1502,11 @@ int madvise_set_anon_name(struct mm_struct *mm, unsigned long start,
  *		triggering read faults if required
  *  MADV_POPULATE_WRITE - populate (prefault) page tables writable by
  *		triggering write faults if required
+ *  MADV_POPULATE_LOCKED - mlock and populate (prefault) the range, backing
+ *		anonymous memory by transparent huge pages where possible.
+ *		Only valid on the caller's own address space; use
+ *		process_madvise() on self with several iovecs to get the
+ *		number of bytes completed so far.
  *
  * return values:
  *  zero    - success
@@ -1440,6 +1553,13 @@ int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in, int beh
 		return madvise_inject_error(behavior, start, start + len_in);
 #endif
 
+	/* Takes mmap_lock itself, the way mlock() does */
+	if (behavior == MADV_POPULATE_LOCKED)
+		return madvise_populate_locked(mm, start, end);
+
+	if (madvise_vma_lock(mm, start, len, behavior, &error))
+		return error;
+
 	write = madvise_need_mmap_write(behavior);
 	if (write) {
 		if (mmap_write_lock_killable(mm))
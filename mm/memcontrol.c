@@ -91,6 +91,10 @@ static bool cgroup_memory_nokmem __ro_after_init;
 /* BPF memory accounting disabled? */
 static bool cgroup_memory_nobpf __ro_after_init;
 
+/* Never flush stats inline from reclaim and fault paths? */
+static bool cgroup_memory_asyncflush __ro_after_init =
+	IS_ENABLED(CONFIG_PREEMPT_RT);
+
 #ifdef CONFIG_CGROUP_WRITEBACK
 static DECLARE_WAIT_QUEUE_HEAD(memcg_cgwb_frn_waitq);
 #endif
@@ -478,6 +482,9 @@ struct memcg_vmstats_percpu {
 	/* Stats updates since the last flush */
 	unsigned int			stats_updates;
 
+	/* When the first of those updates was made, in jiffies */
+	unsigned long			batch_start;
+
 	/* Cached pointers for fast iteration in memcg_rstat_updated() */
 	struct memcg_vmstats_percpu	*parent;
 	struct memcg_vmstats		*vmstats;
@@ -508,6 +515,9 @@ struct memcg_vmstats {
 
 	/* Stats updates since the last flush */
 	atomic64_t		stats_updates;
+
+	/* jiffies_64 of the last flush rooted at this memcg */
+	u64			last_flush;
 };
 
 /*
@@ -524,12 +534,26 @@ struct memcg_vmstats {
  *    (MEMCG_CHARGE_BATCH * nr_cpus) update events. Though this optimization
  *    will let stats be out of sync by atmost (MEMCG_CHARGE_BATCH * nr_cpus) but
  *    only for 2 seconds due to (1).
+ *
+ * 3) With cgroup.memory=asyncflush (the default on PREEMPT_RT), readers only
+ *    flush synchronously if the last flush covering them is older than
+ *    FLUSH_TIME; otherwise they kick the periodic flusher and read the
+ *    slightly stale values. Reclaim and refault paths never flush inline.
+ *    Per-cpu updates are also folded into the flush threshold once they are
+ *    FLUSH_BATCH_LATENCY old, so a CPU that only makes a few updates cannot
+ *    hide them from the threshold check for longer than that.
+ *
+ * Limit checks that must see current values, such as the zswap ones, flush
+ * with a staleness bound of 0 or call do_flush_stats() directly.
  */
 static void flush_memcg_stats_dwork(struct work_struct *w);
 static DECLARE_DEFERRABLE_WORK(stats_flush_dwork, flush_memcg_stats_dwork);
 static u64 flush_last_time;
+static unsigned long flush_kicked;
 
 #define FLUSH_TIME (2UL*HZ)
+#define FLUSH_KICK_DELAY (HZ/10)
+#define FLUSH_BATCH_LATENCY (HZ/10)
 
 /*
  * Accessors to ensure that preemption is disabled on PREEMPT_RT because it can
@@ -572,9 +596,15 @@ static inline void memcg_rstat_updated(struct mem_cgroup *memcg, int val)
 	cgroup_rstat_updated(memcg->css.cgroup, cpu);
 	statc = this_cpu_ptr(memcg->vmstats_percpu);
 	for (; statc; statc = statc->parent) {
-		stats_updates = READ_ONCE(statc->stats_updates) + abs(val);
+		stats_updates = READ_ONCE(statc->stats_updates);
+		if (!stats_updates)
+			WRITE_ONCE(statc->batch_start, jiffies);
+		stats_updates += abs(val);
 		WRITE_ONCE(statc->stats_updates, stats_updates);
-		if (stats_updates < MEMCG_CHARGE_BATCH)
+		if (stats_updates < MEMCG_CHARGE_BATCH &&
+		    (!cgroup_memory_asyncflush ||
+		     time_before(jiffies, READ_ONCE(statc->batch_start) +
+					  FLUSH_BATCH_LATENCY)))
 			continue;
 
 		/*
@@ -592,10 +622,24 @@ static void do_flush_stats(struct mem_cgroup *memcg)
 {
 	if (mem_cgroup_is_root(memcg))
 		WRITE_ONCE(flush_last_time, jiffies_64);
+	WRITE_ONCE(memcg->vmstats->last_flush, jiffies_64);
 
 	cgroup_rstat_flush(memcg->css.cgroup);
 }
 
+/*
+ * Have the periodic flusher run soon rather than flushing inline. Kicks are
+ * batched: the flush runs FLUSH_KICK_DELAY after the first one, further kicks
+ * until then are no-ops.
+ */
+static void kick_flush_stats(void)
+{
+	if (test_and_set_bit(0, &flush_kicked))
+		return;
+	mod_delayed_work(system_unbound_wq, &stats_flush_dwork,
+			 FLUSH_KICK_DELAY);
+}
+
 /*
  * mem_cgroup_flush_stats - flush the stats of a memory cgroup subtree
  * @memcg: root of the subtree to flush
@@ -613,15 +657,61 @@ void mem_cgroup_flush_stats(struct mem_cgroup *memcg)
 	if (!memcg)
 		memcg = root_mem_cgroup;
 
+	if (cgroup_memory_asyncflush) {
+		mem_cgroup_flush_stats_bounded(memcg, FLUSH_TIME);
+		return;
+	}
+
 	if (memcg_vmstats_needs_flush(memcg->vmstats))
 		do_flush_stats(memcg);
 }
 
+/*
+ * mem_cgroup_flush_stats_bounded - flush the stats of a memory cgroup subtree
+ * unless they are recent enough
+ * @memcg: root of the subtree to flush
+ * @max_staleness: maximum age of the stats, in jiffies
+ *
+ * Like mem_cgroup_flush_stats(), but only flushes synchronously if the last
+ * flush covering @memcg, of the whole hierarchy or rooted at @memcg, is older
+ * than @max_staleness. Otherwise the periodic flusher is kicked so that the
+ * next reader sees fresher stats, and the caller does not wait for it.
+ * A @max_staleness of 0 flushes whenever the update threshold is crossed,
+ * as mem_cgroup_flush_stats() does without asyncflush.
+ */
+void mem_cgroup_flush_stats_bounded(struct mem_cgroup *memcg,
+				    unsigned long max_staleness)
+{
+	u64 last;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	if (!memcg)
+		memcg = root_mem_cgroup;
+
+	if (!memcg_vmstats_needs_flush(memcg->vmstats))
+		return;
+
+	last = max(READ_ONCE(flush_last_time),
+		   READ_ONCE(memcg->vmstats->last_flush));
+	if (time_before64(jiffies_64, last + max_staleness)) {
+		kick_flush_stats();
+		return;
+	}
+
+	do_flush_stats(memcg);
+}
+
 void mem_cgroup_flush_stats_ratelimited(struct mem_cgroup *memcg)
 {
 	/* Only flush if the periodic flusher is one full cycle late */
-	if (time_after64(jiffies_64, READ_ONCE(flush_last_time) + 2*FLUSH_TIME))
-		mem_cgroup_flush_stats(memcg);
+	if (time_after64(jiffies_64, READ_ONCE(flush_last_time) + 2*FLUSH_TIME)) {
+		if (cgroup_memory_asyncflush)
+			kick_flush_stats();
+		else
+			mem_cgroup_flush_stats(memcg);
+	}
 }
 
 static void flush_memcg_stats_dwork(struct work_struct *w)
@@ -630,6 +720,7 @@ static void flush_memcg_stats_dwork(struct work_struct *w)
 	 * Deliberately ignore memcg_vmstats_needs_flush() here so that flushing
 	 * in latency-sensitive paths is as cheap as possible.
 	 */
+	clear_bit(0, &flush_kicked);
 	do_flush_stats(root_mem_cgroup);
 	queue_delayed_work(system_unbound_wq, &stats_flush_dwork, FLUSH_TIME);
 }
@@ -1699,10 +1790,18 @@ void mem_cgroup_print_oom_group(struct mem_cgroup *memcg)
 	pr_cont(" are going to be killed due to memory.oom.group set\n");
 }
 
+/*
+ * Number of memcgs whose precharges a cpu caches at once. With many
+ * containers sharing cpus a single slot is drained and refilled on nearly
+ * every charge, bouncing the page_counter cachelines up the hierarchy.
+ */
+#define NR_MEMCG_STOCK 7
+
 struct memcg_stock_pcp {
 	local_lock_t stock_lock;
-	struct mem_cgroup *cached; /* this never be root cgroup */
-	unsigned int nr_pages;
+	struct mem_cgroup *cached[NR_MEMCG_STOCK]; /* never the root cgroup */
+	unsigned int nr_pages[NR_MEMCG_STOCK];
+	unsigned int evict_next;
 
 	struct obj_cgroup *cached_objcg;
 	struct pglist_data *cached_pgdat;
@@ -1728,9 +1827,9 @@ static bool obj_stock_flush_required(struct memcg_stock_pcp *stock,
  * @memcg: memcg to consume from.
  * @nr_pages: how many pages to charge.
  *
- * The charges will only happen if @memcg matches the current cpu's memcg
- * stock, and at least @nr_pages are available in that stock.  Failure to
- * service an allocation will refill the stock.
+ * The charges will only happen if @memcg is one of the memcgs stocked on
+ * the current cpu, and at least @nr_pages are available in its slot.
+ * Failure to service an allocation will refill the stock.
  *
  * returns true if successful, false otherwise.
  */
@@ -1740,6 +1839,7 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	unsigned int stock_pages;
 	unsigned long flags;
 	bool ret = false;
+	int i;
 
 	if (nr_pages > MEMCG_CHARGE_BATCH)
 		return ret;
@@ -1747,11 +1847,17 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	local_lock_irqsave(&memcg_stock.stock_lock, flags);
 
 	stock = this_cpu_ptr(&memcg_stock);
-	stock_pages = READ_ONCE(stock->nr_pages);
-	if (memcg == READ_ONCE(stock->cached) && stock_pages >= nr_pages) {
-		WRITE_ONCE(stock->nr_pages, stock_pages - nr_pages);
-		ret = true;
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		if (memcg != READ_ONCE(stock->cached[i]))
+			continue;
+		stock_pages = READ_ONCE(stock->nr_pages[i]);
+		if (stock_pages >= nr_pages) {
+			WRITE_ONCE(stock->nr_pages[i], stock_pages - nr_pages);
+			ret = true;
+		}
+		break;
 	}
+	count_vm_event(ret ? MEMCG_STOCK_HIT : MEMCG_STOCK_MISS);
 
 	local_unlock_irqrestore(&memcg_stock.stock_lock, flags);
 
@@ -1759,12 +1865,12 @@ static bool consume_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 }
 
 /*
- * Returns stocks cached in percpu and reset cached information.
+ * Returns the stock cached in slot @i and resets its cached information.
  */
-static void drain_stock(struct memcg_stock_pcp *stock)
+static void drain_stock(struct memcg_stock_pcp *stock, int i)
 {
-	unsigned int stock_pages = READ_ONCE(stock->nr_pages);
-	struct mem_cgroup *old = READ_ONCE(stock->cached);
+	unsigned int stock_pages = READ_ONCE(stock->nr_pages[i]);
+	struct mem_cgroup *old = READ_ONCE(stock->cached[i]);
 
 	if (!old)
 		return;
@@ -1774,11 +1880,19 @@ static void drain_stock(struct memcg_stock_pcp *stock)
 		if (do_memsw_account())
 			page_counter_uncharge(&old->memsw, stock_pages);
 
-		WRITE_ONCE(stock->nr_pages, 0);
+		WRITE_ONCE(stock->nr_pages[i], 0);
 	}
 
 	css_put(&old->css);
-	WRITE_ONCE(stock->cached, NULL);
+	WRITE_ONCE(stock->cached[i], NULL);
+}
+
+static void drain_stock_fully(struct memcg_stock_pcp *stock)
+{
+	int i;
+
+	for (i = 0; i < NR_MEMCG_STOCK; i++)
+		drain_stock(stock, i);
 }
 
 static void drain_local_stock(struct work_struct *dummy)
@@ -1796,7 +1910,7 @@ static void drain_local_stock(struct work_struct *dummy)
 
 	stock = this_cpu_ptr(&memcg_stock);
 	old = drain_obj_stock(stock);
-	drain_stock(stock);
+	drain_stock_fully(stock);
 	clear_bit(FLUSHING_CACHED_CHARGE, &stock->flags);
 
 	local_unlock_irqrestore(&memcg_stock.stock_lock, flags);
@@ -1804,25 +1918,60 @@ static void drain_local_stock(struct work_struct *dummy)
 }
 
 /*
- * Cache charges(val) to local per_cpu area.
+ * Drain the stock of another CPU under its stock_lock instead of scheduling
+ * drain_local_stock() there. Only possible if local_lock_remote_allowed().
+ */
+static void drain_remote_stock(int cpu)
+{
+	struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
+	struct obj_cgroup *old;
+
+	local_lock_cpu(&memcg_stock.stock_lock, cpu);
+	old = drain_obj_stock(stock);
+	drain_stock_fully(stock);
+	clear_bit(FLUSHING_CACHED_CHARGE, &stock->flags);
+	local_unlock_cpu(&memcg_stock.stock_lock, cpu);
+	obj_cgroup_put(old);
+}
+
+/*
+ * Cache charges(val) to the given per_cpu area, which is the local one
+ * unless it is being drained remotely. @memcg's slot is reused if it has
+ * one, else a free slot is taken, else the slots are evicted round-robin.
  * This will be consumed by consume_stock() function, later.
  */
-static void __refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
+static void __refill_stock(struct memcg_stock_pcp *stock,
+			   struct mem_cgroup *memcg, unsigned int nr_pages)
 {
-	struct memcg_stock_pcp *stock;
 	unsigned int stock_pages;
+	struct mem_cgroup *cached;
+	int i, empty = -1;
 
-	stock = this_cpu_ptr(&memcg_stock);
-	if (READ_ONCE(stock->cached) != memcg) { /* reset if necessary */
-		drain_stock(stock);
+	for (i = 0; i < NR_MEMCG_STOCK; i++) {
+		cached = READ_ONCE(stock->cached[i]);
+		if (cached == memcg)
+			break;
+		if (!cached && empty < 0)
+			empty = i;
+	}
+
+	if (i == NR_MEMCG_STOCK) {
+		if (empty < 0) {
+			i = stock->evict_next;
+			stock->evict_next = (i + 1) % NR_MEMCG_STOCK;
+			drain_stock(stock, i);
+			count_vm_event(MEMCG_STOCK_EVICT);
+		} else {
+			i = empty;
+		}
 		css_get(&memcg->css);
-		WRITE_ONCE(stock->cached, memcg);
+		WRITE_ONCE(stock->cached[i], memcg);
 	}
-	stock_pages = READ_ONCE(stock->nr_pages) + nr_pages;
-	WRITE_ONCE(stock->nr_pages, stock_pages);
+	stock_pages = READ_ONCE(stock->nr_pages[i]) + nr_pages;
+	WRITE_ONCE(stock->nr_pages[i], stock_pages);
 
 	if (stock_pages > MEMCG_CHARGE_BATCH)
-		drain_stock(stock);
+		drain_stock(stock, i);
 }
 
 static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
@@ -1830,7 +1979,7 @@ static void refill_stock(struct mem_cgroup *memcg, unsigned int nr_pages)
 	unsigned long flags;
 
 	local_lock_irqsave(&memcg_stock.stock_lock, flags);
-	__refill_stock(memcg, nr_pages);
+	__refill_stock(this_cpu_ptr(&memcg_stock), memcg, nr_pages);
 	local_unlock_irqrestore(&memcg_stock.stock_lock, flags);
 }
 
@@ -1857,13 +2006,18 @@ void drain_all_stock(struct mem_cgroup *root_memcg)
 		struct memcg_stock_pcp *stock = &per_cpu(memcg_stock, cpu);
 		struct mem_cgroup *memcg;
 		bool flush = false;
+		int i;
 
 		rcu_read_lock();
-		memcg = READ_ONCE(stock->cached);
-		if (memcg && READ_ONCE(stock->nr_pages) &&
-		    mem_cgroup_is_descendant(memcg, root_memcg))
-			flush = true;
-		else if (obj_stock_flush_required(stock, root_memcg))
+		for (i = 0; i < NR_MEMCG_STOCK; i++) {
+			memcg = READ_ONCE(stock->cached[i]);
+			if (memcg && READ_ONCE(stock->nr_pages[i]) &&
+			    mem_cgroup_is_descendant(memcg, root_memcg)) {
+				flush = true;
+				break;
+			}
+		}
+		if (!flush && obj_stock_flush_required(stock, root_memcg))
 			flush = true;
 		rcu_read_unlock();
 
@@ -1871,6 +2025,8 @@ void drain_all_stock(struct mem_cgroup *root_memcg)
 		    !test_and_set_bit(FLUSHING_CACHED_CHARGE, &stock->flags)) {
 			if (cpu == curcpu)
 				drain_local_stock(&stock->work);
+			else if (local_lock_remote_allowed())
+				drain_remote_stock(cpu);
 			else if (!cpu_is_isolated(cpu))
 				schedule_work_on(cpu, &stock->work);
 		}
@@ -1884,7 +2040,14 @@ static int memcg_hotplug_cpu_dead(unsigned int cpu)
 	struct memcg_stock_pcp *stock;
 
 	stock = &per_cpu(memcg_stock, cpu);
-	drain_stock(stock);
+	/* Serialize against drain_remote_stock() */
+	if (local_lock_remote_allowed()) {
+		local_lock_cpu(&memcg_stock.stock_lock, cpu);
+		drain_stock_fully(stock);
+		local_unlock_cpu(&memcg_stock.stock_lock, cpu);
+	} else {
+		drain_stock_fully(stock);
+	}
 
 	return 0;
 }
@@ -2765,6 +2928,7 @@ static bool consume_obj_stock(struct obj_cgroup *objcg, unsigned int nr_bytes)
 		stock->nr_bytes -= nr_bytes;
 		ret = true;
 	}
+	count_vm_event(ret ? MEMCG_OBJ_STOCK_HIT : MEMCG_OBJ_STOCK_MISS);
 
 	local_unlock_irqrestore(&memcg_stock.stock_lock, flags);
 
@@ -2789,7 +2953,7 @@ static struct obj_cgroup *drain_obj_stock(struct memcg_stock_pcp *stock)
 
 			mod_memcg_state(memcg, MEMCG_KMEM, -nr_pages);
 			memcg1_account_kmem(memcg, -nr_pages);
-			__refill_stock(memcg, nr_pages);
+			__refill_stock(stock, memcg, nr_pages);
 
 			css_put(&memcg->css);
 		}
@@ -3575,6 +3739,9 @@ mem_cgroup_css_alloc(struct cgroup_subsys_state *parent_css)
 #ifdef CONFIG_ZSWAP
 	memcg->zswap_max = PAGE_COUNTER_MAX;
 	WRITE_ONCE(memcg->zswap_writeback, true);
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	WRITE_ONCE(memcg->khugepaged_weight, CGROUP_WEIGHT_DFL);
 #endif
 	page_counter_set_high(&memcg->swap, PAGE_COUNTER_MAX);
 	if (parent) {
@@ -4275,6 +4442,96 @@ static ssize_t memory_oom_group_write(struct kernfs_open_file *of,
 	return nbytes;
 }
 
+/*
+ * Account a direct reclaim run of @ns to @memcg, or to the memcg of the
+ * current task for global reclaim, and to all their ancestors.
+ */
+void mem_cgroup_record_reclaim_latency(struct mem_cgroup *memcg, u64 ns)
+{
+	u64 us = div_u64(ns, NSEC_PER_USEC);
+	unsigned int bucket = us ? ilog2(us) : 0;
+	struct mem_cgroup *iter;
+	bool put = false;
+
+	if (mem_cgroup_disabled())
+		return;
+
+	if (!memcg) {
+		memcg = get_mem_cgroup_from_current();
+		put = true;
+	}
+
+	bucket = min(bucket, MEMCG_RECLAIM_LAT_BUCKETS - 1);
+	for (iter = memcg; iter; iter = parent_mem_cgroup(iter))
+		atomic_long_inc(&iter->reclaim_latency[bucket]);
+
+	if (put)
+		mem_cgroup_put(memcg);
+}
+
+static int memory_reclaim_latency_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_seq(m);
+	int i;
+
+	for (i = 0; i < MEMCG_RECLAIM_LAT_BUCKETS - 1; i++)
+		seq_printf(m, "lt_%luus %ld\n", 2UL << i,
+			   atomic_long_read(&memcg->reclaim_latency[i]));
+	seq_printf(m, "ge_%luus %ld\n", 1UL << i,
+		   atomic_long_read(&memcg->reclaim_latency[i]));
+
+	return 0;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * khugepaged scans the mms of a memcg with a budget proportional to its
+ * memory.khugepaged.weight, and queues newly registered mms of memcgs
+ * above the default weight ahead of the others.
+ */
+unsigned int mem_cgroup_khugepaged_weight(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg;
+	unsigned int weight;
+
+	if (mem_cgroup_disabled())
+		return CGROUP_WEIGHT_DFL;
+
+	memcg = get_mem_cgroup_from_mm(mm);
+	weight = READ_ONCE(memcg->khugepaged_weight);
+	css_put(&memcg->css);
+
+	return weight;
+}
+
+static int memory_khugepaged_weight_show(struct seq_file *m, void *v)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_seq(m);
+
+	seq_printf(m, "%u\n", READ_ONCE(memcg->khugepaged_weight));
+	return 0;
+}
+
+static ssize_t memory_khugepaged_weight_write(struct kernfs_open_file *of,
+					      char *buf, size_t nbytes,
+					      loff_t off)
+{
+	struct mem_cgroup *memcg = mem_cgroup_from_css(of_css(of));
+	unsigned int weight;
+	int ret;
+
+	ret = kstrtouint(strstrip(buf), 0, &weight);
+	if (ret)
+		return ret;
+
+	if (weight < CGROUP_WEIGHT_MIN || weight > CGROUP_WEIGHT_MAX)
+		return -ERANGE;
+
+	WRITE_ONCE(memcg->khugepaged_weight, weight);
+	return nbytes;
+}
+#endif
+
 enum {
 	MEMORY_RECLAIM_SWAPPINESS = 0,
 	MEMORY_RECLAIM_NULL,
@@ -4417,11 +4674,23 @@ static struct cftype memory_files[] = {
 		.seq_show = memory_oom_group_show,
 		.write = memory_oom_group_write,
 	},
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	{
+		.name = "khugepaged.weight",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.seq_show = memory_khugepaged_weight_show,
+		.write = memory_khugepaged_weight_write,
+	},
+#endif
 	{
 		.name = "reclaim",
 		.flags = CFTYPE_NS_DELEGATABLE,
 		.write = memory_reclaim,
 	},
+	{
+		.name = "reclaim.latency",
+		.seq_show = memory_reclaim_latency_show,
+	},
 	{ }	/* terminate */
 };
 
@@ -4887,6 +5156,10 @@ static int __init cgroup_memory(char *s)
 			cgroup_memory_nokmem = true;
 		if (!strcmp(token, "nobpf"))
 			cgroup_memory_nobpf = true;
+		if (!strcmp(token, "asyncflush"))
+			cgroup_memory_asyncflush = true;
+		if (!strcmp(token, "syncflush"))
+			cgroup_memory_asyncflush = false;
 	}
 	return 1;
 }
@@ -180,8 +180,68 @@ static ssize_t nodelist_show(struct device *dev,
 }
 static DEVICE_ATTR_RO(nodelist);
 
+/*
+ * Promotion and demotion counters summed over the nodes of the tier:
+ * promotions are counted on the destination node, demotions on the
+ * source node.
+ */
+static ssize_t stats_show(struct device *dev,
+			  struct device_attribute *attr, char *buf)
+{
+	struct kpromoted_stats kstats = {};
+	unsigned long promoted = 0, candidate = 0;
+	unsigned long demoted[3] = {};
+	nodemask_t nmask;
+	int nid, i, len = 0;
+
+	mutex_lock(&memory_tier_lock);
+	nmask = get_memtier_nodemask(to_memory_tier(dev));
+	mutex_unlock(&memory_tier_lock);
+
+	for_each_node_mask(nid, nmask) {
+		struct pglist_data *pgdat = NODE_DATA(nid);
+
+		if (!node_state(nid, N_MEMORY))
+			continue;
+#ifdef CONFIG_NUMA_BALANCING
+		promoted += node_page_state(pgdat, PGPROMOTE_SUCCESS);
+		candidate += node_page_state(pgdat, PGPROMOTE_CANDIDATE);
+#endif
+		demoted[0] += node_page_state(pgdat, PGDEMOTE_KSWAPD);
+		demoted[1] += node_page_state(pgdat, PGDEMOTE_DIRECT);
+		demoted[2] += node_page_state(pgdat, PGDEMOTE_KHUGEPAGED);
+		kpromoted_read_stats(nid, &kstats);
+	}
+
+	len += sysfs_emit_at(buf, len, "pgpromote_success %lu\n", promoted);
+	len += sysfs_emit_at(buf, len, "pgpromote_candidate %lu\n", candidate);
+	len += sysfs_emit_at(buf, len, "pgdemote_kswapd %lu\n", demoted[0]);
+	len += sysfs_emit_at(buf, len, "pgdemote_direct %lu\n", demoted[1]);
+	len += sysfs_emit_at(buf, len, "pgdemote_khugepaged %lu\n", demoted[2]);
+	if (!IS_ENABLED(CONFIG_KPROMOTED))
+		return len;
+
+	len += sysfs_emit_at(buf, len, "kpromoted_queued %lu\n", kstats.queued);
+	len += sysfs_emit_at(buf, len, "kpromoted_dropped %lu\n",
+			     kstats.dropped);
+	len += sysfs_emit_at(buf, len, "kpromoted_promoted %lu\n",
+			     kstats.promoted);
+	len += sysfs_emit_at(buf, len, "kpromoted_failed %lu\n", kstats.failed);
+	len += sysfs_emit_at(buf, len, "kpromoted_throttled %lu\n",
+			     kstats.throttled);
+	for (i = 0; i < KPROMOTED_NR_LAT_BUCKETS - 1; i++)
+		len += sysfs_emit_at(buf, len, "kpromoted_latency_lt_%luus %lu\n",
+				     2UL << i, kstats.latency[i]);
+	len += sysfs_emit_at(buf, len, "kpromoted_latency_ge_%luus %lu\n",
+			     1UL << i, kstats.latency[i]);
+
+	return len;
+}
+static DEVICE_ATTR_RO(stats);
+
 static struct attribute *memtier_dev_attrs[] = {
 	&dev_attr_nodelist.attr,
+	&dev_attr_stats.attr,
 	NULL
 };
 
@@ -3275,6 +3275,7 @@ static inline vm_fault_t vmf_can_call_fault(const struct vm_fault *vmf)
 	if (vma->vm_ops->map_pages || !(vmf->flags & FAULT_FLAG_VMA_LOCK))
 		return 0;
 	vma_end_read(vma);
+	count_vm_vma_lock_event(VMA_LOCK_FALLBACK_FAULT);
 	return VM_FAULT_RETRY;
 }
 
@@ -3301,8 +3302,10 @@ vm_fault_t __vmf_anon_prepare(struct vm_fault *vmf)
 	if (likely(vma->anon_vma))
 		return 0;
 	if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
-		if (!mmap_read_trylock(vma->vm_mm))
+		if (!mmap_read_trylock(vma->vm_mm)) {
+			count_vm_vma_lock_event(VMA_LOCK_FALLBACK_ANON);
 			return VM_FAULT_RETRY;
+		}
 	}
 	if (__anon_vma_prepare(vma))
 		ret = VM_FAULT_OOM;
@@ -4069,11 +4072,12 @@ static bool can_swapin_thp(struct vm_fault *vmf, pte_t *ptep, int nr_pages)
 
 	/*
 	 * swap_read_folio() can't handle the case a large folio is hybridly
-	 * from different backends. And they are likely corner cases. Similar
-	 * things might be added once zswap support large folios.
+	 * from different backends. And they are likely corner cases.
 	 */
 	if (unlikely(swap_zeromap_batch(entry, nr_pages, NULL) != nr_pages))
 		return false;
+	if (unlikely(zswap_present_batch(entry, nr_pages, NULL) != nr_pages))
+		return false;
 	if (unlikely(non_swapcache_batch(entry, nr_pages) != nr_pages))
 		return false;
 
@@ -4122,14 +4126,6 @@ static struct folio *alloc_swap_folio(struct vm_fault *vmf)
 	if (unlikely(userfaultfd_armed(vma)))
 		goto fallback;
 
-	/*
-	 * A large swapped out folio could be partially or fully in zswap. We
-	 * lack handling for such cases, so fallback to swapping in order-0
-	 * folio.
-	 */
-	if (!zswap_never_enabled())
-		goto fallback;
-
 	entry = pte_to_swp_entry(vmf->orig_pte);
 	/*
 	 * Get a list of all the (large) orders below PMD_ORDER that are enabled
@@ -4234,6 +4230,7 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 				 * under VMA lock.
 				 */
 				vma_end_read(vma);
+				count_vm_vma_lock_event(VMA_LOCK_FALLBACK_DEVICE);
 				ret = VM_FAULT_RETRY;
 				goto out;
 			}
@@ -4307,6 +4304,17 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 				}
 				need_clear_cache = true;
 
+				/*
+				 * zswap writeback may have moved part of the
+				 * range to disk since can_swapin_thp() looked;
+				 * the cache flag keeps it away from now on.
+				 * Retry, the fault then swaps in order-0.
+				 */
+				if (folio_test_large(folio) &&
+				    zswap_present_batch(entry, nr_pages, NULL) !=
+				    nr_pages)
+					goto out_page;
+
 				mem_cgroup_swapin_uncharge_swap(entry, nr_pages);
 
 				shadow = get_shadow_from_swap_cache(entry);
@@ -5590,6 +5598,9 @@ static vm_fault_t do_numa_page(struct vm_fault *vmf)
 					writable, &last_cpupid);
 	if (target_nid == NUMA_NO_NODE)
 		goto out_map;
+	/* Promotions may be left to kpromoted, off the fault path */
+	if (kpromoted_record_access(folio, target_nid))
+		goto out_map;
 	if (migrate_misplaced_folio_prepare(folio, vma, target_nid)) {
 		flags |= TNF_MIGRATE_FAIL;
 		goto out_map;
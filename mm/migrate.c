@@ -2614,7 +2614,8 @@ static struct folio *alloc_misplaced_dst_folio(struct folio *src,
 
 /*
  * Prepare for calling migrate_misplaced_folio() by isolating the folio if
- * permitted. Must be called with the PTL still held.
+ * permitted. Must be called with the PTL still held, or with a folio
+ * reference and a NULL @vma when the folio is not found through a mapping.
  */
 int migrate_misplaced_folio_prepare(struct folio *folio,
 		struct vm_area_struct *vma, int node)
@@ -2631,7 +2632,7 @@ int migrate_misplaced_folio_prepare(struct folio *folio,
 		 * See folio_likely_mapped_shared() on possible imprecision
 		 * when we cannot easily detect if a folio is shared.
 		 */
-		if ((vma->vm_flags & VM_EXEC) &&
+		if ((!vma || (vma->vm_flags & VM_EXEC)) &&
 		    folio_likely_mapped_shared(folio))
 			return -EACCES;
 
@@ -2710,5 +2711,26 @@ int migrate_misplaced_folio(struct folio *folio, struct vm_area_struct *vma,
 	BUG_ON(!list_empty(&migratepages));
 	return nr_remaining ? -EAGAIN : 0;
 }
+
+/*
+ * Migrate a list of folios isolated with migrate_misplaced_folio_prepare()
+ * to @node, for asynchronous promotion. Returns the number of pages
+ * migrated; the folios left over are put back.
+ */
+unsigned int migrate_misplaced_folio_list(struct list_head *folios, int node)
+{
+	unsigned int nr_succeeded = 0;
+
+	migrate_pages(folios, alloc_misplaced_dst_folio, NULL, node,
+		      MIGRATE_ASYNC, MR_NUMA_MISPLACED, &nr_succeeded);
+	if (!list_empty(folios))
+		putback_movable_pages(folios);
+	if (nr_succeeded) {
+		count_vm_numa_events(NUMA_PAGE_MIGRATE, nr_succeeded);
+		mod_node_page_state(NODE_DATA(node), PGPROMOTE_SUCCESS,
+				    nr_succeeded);
+	}
+	return nr_succeeded;
+}
 #endif /* CONFIG_NUMA_BALANCING */
 #endif /* CONFIG_NUMA */
@@ -224,6 +224,15 @@ void mlock_drain_remote(int cpu)
 {
 	struct folio_batch *fbatch;
 
+	if (local_lock_remote_allowed()) {
+		local_lock_cpu(&mlock_fbatch.lock, cpu);
+		fbatch = &per_cpu(mlock_fbatch.fbatch, cpu);
+		if (folio_batch_count(fbatch))
+			mlock_folio_batch(fbatch);
+		local_unlock_cpu(&mlock_fbatch.lock, cpu);
+		return;
+	}
+
 	WARN_ON_ONCE(cpu_online(cpu));
 	fbatch = &per_cpu(mlock_fbatch.fbatch, cpu);
 	if (folio_batch_count(fbatch))
@@ -473,7 +482,7 @@ static int mlock_fixup(struct vma_iterator *vmi, struct vm_area_struct *vma,
 	vm_flags_t oldflags = vma->vm_flags;
 
 	if (newflags == oldflags || (oldflags & VM_SPECIAL) ||
-	    is_vm_hugetlb_page(vma) || vma == get_gate_vma(current->mm) ||
+	    is_vm_hugetlb_page(vma) || vma == get_gate_vma(mm) ||
 	    vma_is_dax(vma) || vma_is_secretmem(vma) || (oldflags & VM_DROPPABLE))
 		/* don't set VM_LOCKED or VM_LOCKONFAULT and don't count */
 		goto out;
@@ -561,6 +570,56 @@ static int apply_vma_lock_flags(unsigned long start, size_t len,
 	return 0;
 }
 
+/*
+ * Set or, if !@lock, clear VM_LOCKED on the vmas of @mm covering
+ * [start, end), on behalf of a kernel agent rather than the owner of @mm:
+ * holes are skipped, the pages are not populated and RLIMIT_MEMLOCK is not
+ * checked. Pages that are already mapped are mlocked or munlocked. Vmas
+ * that are already locked are left alone when locking. The caller holds
+ * the mmap_lock for writing.
+ *
+ * Returns the number of bytes whose VM_LOCKED changed, or an error.
+ */
+long mlock_mm_range(struct mm_struct *mm, unsigned long start,
+		    unsigned long end, bool lock)
+{
+	struct vm_area_struct *vma, *prev;
+	VMA_ITERATOR(vmi, mm, start);
+	unsigned long changed = 0;
+	int error = 0;
+
+	mmap_assert_write_locked(mm);
+
+	vma = vma_find(&vmi, end);
+	if (!vma)
+		return 0;
+
+	prev = vma_prev(&vmi);
+	if (start > vma->vm_start)
+		prev = vma;
+
+	for_each_vma_range(vmi, vma, end) {
+		unsigned long vstart = max(start, vma->vm_start);
+		unsigned long vend = min(end, vma->vm_end);
+		vm_flags_t newflags;
+
+		if (!!(vma->vm_flags & VM_LOCKED) == lock) {
+			prev = vma;
+			continue;
+		}
+
+		newflags = vma->vm_flags & ~VM_LOCKED_MASK;
+		if (lock)
+			newflags |= VM_LOCKED;
+		error = mlock_fixup(&vmi, vma, &prev, vstart, vend, newflags);
+		if (error)
+			break;
+		changed += vend - vstart;
+	}
+
+	return error ? error : changed;
+}
+
 /*
  * Go through vma areas and sum size of mlocked
  * vma pages, as return value.
@@ -609,7 +668,7 @@ static int __mlock_posix_error_return(long retval)
 	return retval;
 }
 
-static __must_check int do_mlock(unsigned long start, size_t len, vm_flags_t flags)
+int do_mlock(unsigned long start, size_t len, vm_flags_t flags)
 {
 	unsigned long locked;
 	unsigned long lock_limit;
@@ -2384,6 +2384,191 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 }
 #endif
 
+#ifdef CONFIG_PREEMPT_RT
+/*
+ * On PREEMPT_RT the pcp lock is a sleeping spinlock, which makes every
+ * order-0 allocation and free through the pcplists comparatively expensive.
+ * A small magazine of order-0 pages per migratetype sits in front of the
+ * pcplists and is accessed without the lock. The slots are only ever changed
+ * with fully atomic xchg/cmpxchg, because the local CPU can be preempted in
+ * the middle of an operation and drain_pages_zone() empties the magazine of
+ * remote CPUs.
+ *
+ * Frees fill the magazine directly, allocations refill it in bulk from the
+ * pcplists while holding the lock anyway. A pcp with high_max == 0 is
+ * disabled, see zone_pcp_disable(), and must not cache pages.
+ */
+static struct page *pcp_mag_alloc(struct zone *zone, int migratetype)
+{
+	struct per_cpu_pages *pcp;
+	struct page **slots;
+	struct page *page = NULL;
+	int i;
+
+	/* Pinned, so that a CPU can't go away under us, see pcp_mag_free() */
+	migrate_disable();
+	pcp = this_cpu_ptr(zone->per_cpu_pageset);
+	slots = pcp->mag[migratetype];
+	for (i = 0; i < PCP_MAG_SLOTS; i++) {
+		if (!READ_ONCE(slots[i]))
+			continue;
+
+		page = xchg(&slots[i], NULL);
+		if (!page)
+			continue;
+
+		/* Bad pages are leaked, as in __rmqueue_pcplist() */
+		if (check_new_pages(page, 0)) {
+			page = NULL;
+			continue;
+		}
+
+		break;
+	}
+	migrate_enable();
+
+	return page;
+}
+
+static bool __pcp_mag_free(struct per_cpu_pages *pcp, struct page *page,
+			   int migratetype)
+{
+	struct page **slots = pcp->mag[migratetype];
+	int i;
+
+	if (!READ_ONCE(pcp->high_max))
+		return false;
+
+	for (i = 0; i < PCP_MAG_SLOTS; i++) {
+		if (READ_ONCE(slots[i]))
+			continue;
+
+		if (cmpxchg(&slots[i], NULL, page))
+			continue;
+
+		/*
+		 * The successful cmpxchg() orders against the xchg() in
+		 * pcp_mag_drain(). If the pcp got disabled meanwhile, the
+		 * drain may have missed the page, so take it back unless
+		 * somebody else already did.
+		 */
+		if (unlikely(!READ_ONCE(pcp->high_max)) &&
+		    cmpxchg(&slots[i], page, NULL) == page)
+			return false;
+
+		count_vm_event(PGFREE);
+		return true;
+	}
+
+	return false;
+}
+
+static bool pcp_mag_free(struct zone *zone, struct page *page, int migratetype)
+{
+	bool ret;
+
+	/*
+	 * Pinned to the CPU, otherwise the CPU could go offline and have its
+	 * magazine drained by page_alloc_cpu_dead() before the page is put
+	 * into it, stranding the page.
+	 */
+	migrate_disable();
+	ret = __pcp_mag_free(this_cpu_ptr(zone->per_cpu_pageset), page,
+			     migratetype);
+	migrate_enable();
+
+	return ret;
+}
+
+/* Called with pcp->lock held and a page just taken from @list */
+static void pcp_mag_refill(struct per_cpu_pages *pcp, int migratetype,
+			   struct list_head *list)
+{
+	struct page **slots = pcp->mag[migratetype];
+	struct page *page;
+	int i;
+
+	if (!READ_ONCE(pcp->high_max))
+		return;
+
+	for (i = 0; i < PCP_MAG_SLOTS && !list_empty(list); i++) {
+		if (READ_ONCE(slots[i]))
+			continue;
+
+		/* Unlink first, the slot is visible to lockless users */
+		page = list_first_entry(list, struct page, pcp_list);
+		list_del(&page->pcp_list);
+		if (cmpxchg(&slots[i], NULL, page)) {
+			list_add(&page->pcp_list, list);
+			continue;
+		}
+		pcp->count--;
+	}
+}
+
+/* Move the magazine back onto the pcplists, called with pcp->lock held */
+static void pcp_mag_drain(struct per_cpu_pages *pcp)
+{
+	struct page *page;
+	int mt, i;
+
+	for (mt = 0; mt < MIGRATE_PCPTYPES; mt++) {
+		for (i = 0; i < PCP_MAG_SLOTS; i++) {
+			page = xchg(&pcp->mag[mt][i], NULL);
+			if (!page)
+				continue;
+
+			list_add(&page->pcp_list,
+				 &pcp->lists[order_to_pindex(mt, 0)]);
+			pcp->count++;
+		}
+	}
+}
+
+/*
+ * Pages in the magazine are not accounted in pcp->count, racy check for
+ * __drain_all_pages().
+ */
+static bool pcp_mag_has_pages(struct per_cpu_pages *pcp)
+{
+	int mt, i;
+
+	for (mt = 0; mt < MIGRATE_PCPTYPES; mt++) {
+		for (i = 0; i < PCP_MAG_SLOTS; i++) {
+			if (READ_ONCE(pcp->mag[mt][i]))
+				return true;
+		}
+	}
+
+	return false;
+}
+#else
+static inline struct page *pcp_mag_alloc(struct zone *zone, int migratetype)
+{
+	return NULL;
+}
+
+static inline bool pcp_mag_free(struct zone *zone, struct page *page,
+				int migratetype)
+{
+	return false;
+}
+
+static inline void pcp_mag_refill(struct per_cpu_pages *pcp, int migratetype,
+				  struct list_head *list)
+{
+}
+
+static inline void pcp_mag_drain(struct per_cpu_pages *pcp)
+{
+}
+
+static inline bool pcp_mag_has_pages(struct per_cpu_pages *pcp)
+{
+	return false;
+}
+#endif /* CONFIG_PREEMPT_RT */
+
 /*
  * Drain pcplists of the indicated processor and zone.
  */
@@ -2394,6 +2579,7 @@ static void drain_pages_zone(unsigned int cpu, struct zone *zone)
 
 	do {
 		spin_lock(&pcp->lock);
+		pcp_mag_drain(pcp);
 		count = pcp->count;
 		if (count) {
 			int to_drain = min(count,
@@ -2481,12 +2667,12 @@ static void __drain_all_pages(struct zone *zone, bool force_all_cpus)
 			has_pcps = true;
 		} else if (zone) {
 			pcp = per_cpu_ptr(zone->per_cpu_pageset, cpu);
-			if (pcp->count)
+			if (pcp->count || pcp_mag_has_pages(pcp))
 				has_pcps = true;
 		} else {
 			for_each_populated_zone(z) {
 				pcp = per_cpu_ptr(z->per_cpu_pageset, cpu);
-				if (pcp->count) {
+				if (pcp->count || pcp_mag_has_pages(pcp)) {
 					has_pcps = true;
 					break;
 				}
@@ -2676,6 +2862,9 @@ void free_unref_page(struct page *page, unsigned int order)
 	}
 
 	zone = page_zone(page);
+	if (!order && pcp_mag_free(zone, page, migratetype))
+		return;
+
 	pcp_trylock_prepare(UP_flags);
 	pcp = pcp_spin_trylock(zone->per_cpu_pageset);
 	if (pcp) {
@@ -3027,6 +3216,12 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 	struct page *page;
 	unsigned long __maybe_unused UP_flags;
 
+	if (!order) {
+		page = pcp_mag_alloc(zone, migratetype);
+		if (page)
+			goto out;
+	}
+
 	/* spin_trylock may fail due to a parallel drain or IRQ reentrancy. */
 	pcp_trylock_prepare(UP_flags);
 	pcp = pcp_spin_trylock(zone->per_cpu_pageset);
@@ -3043,8 +3238,11 @@ static struct page *rmqueue_pcplist(struct zone *preferred_zone,
 	pcp->free_count >>= 1;
 	list = &pcp->lists[order_to_pindex(migratetype, order)];
 	page = __rmqueue_pcplist(zone, order, migratetype, alloc_flags, pcp, list);
+	if (page && !order)
+		pcp_mag_refill(pcp, migratetype, list);
 	pcp_spin_unlock(pcp);
 	pcp_trylock_finish(UP_flags);
+out:
 	if (page) {
 		__count_zid_vm_events(PGALLOC, page_zonenum(page), 1 << order);
 		zone_statistics(preferred_zone, zone, 1);
@@ -5885,8 +6083,7 @@ static int page_alloc_cpu_dead(unsigned int cpu)
 {
 	struct zone *zone;
 
-	lru_add_drain_cpu(cpu);
-	mlock_drain_remote(cpu);
+	lru_add_drain_remote(cpu);
 	drain_pages(cpu);
 
 	/*
@@ -57,16 +57,18 @@ static void end_swap_bio_write(struct bio *bio)
 
 static void __end_swap_bio_read(struct bio *bio)
 {
-	struct folio *folio = bio_first_folio_all(bio);
+	struct folio_iter fi;
 
-	if (bio->bi_status) {
+	if (bio->bi_status)
 		pr_alert_ratelimited("Read-error on swap-device (%u:%u:%llu)\n",
 				     MAJOR(bio_dev(bio)), MINOR(bio_dev(bio)),
 				     (unsigned long long)bio->bi_iter.bi_sector);
-	} else {
-		folio_mark_uptodate(folio);
+
+	bio_for_each_folio_all(fi, bio) {
+		if (!bio->bi_status)
+			folio_mark_uptodate(fi.folio);
+		folio_unlock(fi.folio);
 	}
-	folio_unlock(folio);
 }
 
 static void end_swap_bio_read(struct bio *bio)
@@ -320,8 +322,14 @@ static void bio_associate_blkg_from_page(struct bio *bio, struct folio *folio)
 #define bio_associate_blkg_from_page(bio, folio)		do { } while (0)
 #endif /* CONFIG_MEMCG && CONFIG_BLK_CGROUP */
 
+/*
+ * Batches swap IO across a plug: through ->swap_rw() for SWP_FS_OPS, or as
+ * one bio over the bvec array for block devices, in which case ki_filp is
+ * NULL.
+ */
 struct swap_iocb {
 	struct kiocb		iocb;
+	struct bio		bio;
 	struct bio_vec		bvec[SWAP_CLUSTER_MAX];
 	int			pages;
 	int			len;
@@ -592,11 +600,60 @@ static void swap_read_folio_bdev_sync(struct folio *folio,
 	put_task_struct(current);
 }
 
+static void sio_read_bio_complete(struct bio *bio)
+{
+	struct swap_iocb *sio = container_of(bio, struct swap_iocb, bio);
+
+	__end_swap_bio_read(bio);
+	bio_uninit(bio);
+	mempool_free(sio, sio_pool);
+}
+
+/*
+ * Readahead reads folios that are usually next to each other in swap,
+ * merge them into one bio for as long as they are.
+ */
+static void swap_read_folio_bdev_plug(struct folio *folio,
+		struct swap_info_struct *sis, struct swap_iocb **plug)
+{
+	sector_t sector = swap_folio_sector(folio);
+	struct swap_iocb *sio = *plug;
+
+	if (sio) {
+		if (sio->iocb.ki_filp || sio->bio.bi_bdev != sis->bdev ||
+		    bio_end_sector(&sio->bio) != sector ||
+		    !bio_add_folio(&sio->bio, folio, folio_size(folio), 0)) {
+			swap_read_unplug(sio);
+			sio = NULL;
+		}
+	}
+	if (!sio) {
+		sio = mempool_alloc(sio_pool, GFP_KERNEL);
+		sio->iocb.ki_filp = NULL;
+		bio_init(&sio->bio, sis->bdev, sio->bvec,
+			 ARRAY_SIZE(sio->bvec), REQ_OP_READ);
+		sio->bio.bi_iter.bi_sector = sector;
+		sio->bio.bi_end_io = sio_read_bio_complete;
+		bio_add_folio_nofail(&sio->bio, folio, folio_size(folio), 0);
+	}
+	count_vm_events(PSWPIN, folio_nr_pages(folio));
+	if (sio->bio.bi_vcnt == sio->bio.bi_max_vecs) {
+		swap_read_unplug(sio);
+		sio = NULL;
+	}
+	*plug = sio;
+}
+
 static void swap_read_folio_bdev_async(struct folio *folio,
-		struct swap_info_struct *sis)
+		struct swap_info_struct *sis, struct swap_iocb **plug)
 {
 	struct bio *bio;
 
+	if (plug && data_race(sio_pool)) {
+		swap_read_folio_bdev_plug(folio, sis, plug);
+		return;
+	}
+
 	bio = bio_alloc(sis->bdev, 1, REQ_OP_READ, GFP_KERNEL);
 	bio->bi_iter.bi_sector = swap_folio_sector(folio);
 	bio->bi_end_io = end_swap_bio_read;
@@ -644,7 +701,7 @@ void swap_read_folio(struct folio *folio, struct swap_iocb **plug)
 	} else if (synchronous) {
 		swap_read_folio_bdev_sync(folio, sis);
 	} else {
-		swap_read_folio_bdev_async(folio, sis);
+		swap_read_folio_bdev_async(folio, sis, plug);
 	}
 
 finish:
@@ -658,9 +715,15 @@ void swap_read_folio(struct folio *folio, struct swap_iocb **plug)
 void __swap_read_unplug(struct swap_iocb *sio)
 {
 	struct iov_iter from;
-	struct address_space *mapping = sio->iocb.ki_filp->f_mapping;
+	struct address_space *mapping;
 	int ret;
 
+	if (!sio->iocb.ki_filp) {
+		submit_bio(&sio->bio);
+		return;
+	}
+
+	mapping = sio->iocb.ki_filp->f_mapping;
 	iov_iter_bvec(&from, ITER_DEST, sio->bvec, sio->pages, sio->len);
 	ret = mapping->a_ops->swap_rw(&sio->iocb, &from);
 	if (ret != -EIOCBQUEUED)
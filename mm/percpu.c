@@ -50,6 +50,11 @@
  * of the bitmap.  The reverse mapping from page to chunk is stored in
  * the page's index.  Lastly, units are lazily backed and grow in unison.
  *
+ * Small areas are not returned to their chunk right away when freed, but
+ * are kept in a per-cpu cache from which allocations of the same size are
+ * served without taking pcpu_alloc_mutex or pcpu_lock and without scanning
+ * the chunks.  The balance work returns the cached areas to their chunks.
+ *
  * There is a unique conversion that goes on here between bytes and bits.
  * Each bit represents a fragment of size PCPU_MIN_ALLOC_SIZE.  The chunk
  * tracks the number of pages it is responsible for in nr_pages.  Helper
@@ -109,6 +114,10 @@
 #define PCPU_EMPTY_POP_PAGES_LOW	2
 #define PCPU_EMPTY_POP_PAGES_HIGH	4
 
+/* freed areas of up to PCPU_AREA_CACHE_MAX_SIZE bytes are cached per cpu */
+#define PCPU_AREA_CACHE_NR		16
+#define PCPU_AREA_CACHE_MAX_SIZE	256
+
 #ifdef CONFIG_SMP
 /* default addr <-> pcpu_ptr mapping, override in asm/percpu.h if necessary */
 #ifndef __addr_to_pcpu_ptr
@@ -198,6 +207,27 @@ static DECLARE_WORK(pcpu_balance_work, pcpu_balance_workfn);
 static bool pcpu_async_enabled __read_mostly;
 static bool pcpu_atomic_alloc_failed;
 
+/*
+ * Areas in the cache are still allocated in their chunk, and already
+ * zeroed on reuse by pcpu_alloc().  The lock is raw as free_percpu() may
+ * be called from any context; it is only ever contended by the balance
+ * work draining the cache.
+ */
+struct pcpu_area_cache {
+	raw_spinlock_t		lock;
+	int			nr;
+	int			reserved;	/* slots claimed by frees */
+	struct {
+		struct pcpu_chunk	*chunk;
+		int			off;
+		int			size;
+	} areas[PCPU_AREA_CACHE_NR];
+};
+
+static DEFINE_PER_CPU(struct pcpu_area_cache, pcpu_area_cache) = {
+	.lock = __RAW_SPIN_LOCK_UNLOCKED(pcpu_area_cache.lock),
+};
+
 static void pcpu_schedule_balance_work(void)
 {
 	if (pcpu_async_enabled)
@@ -1725,6 +1755,126 @@ static void pcpu_alloc_tag_free_hook(struct pcpu_chunk *chunk, int off, size_t s
 }
 #endif
 
+/**
+ * pcpu_area_cache_get - allocate an area from the local area cache
+ * @size: size of area to allocate in bytes
+ * @align: alignment of area
+ * @chunkp: out param for the chunk of the area
+ *
+ * RETURNS:
+ * Offset of the area in *@chunkp, or -1 if the cache holds no area of
+ * @size bytes with the right alignment.
+ */
+static int pcpu_area_cache_get(size_t size, size_t align,
+			       struct pcpu_chunk **chunkp)
+{
+	struct pcpu_area_cache *cache;
+	unsigned long flags;
+	int i, off = -1;
+
+	if (size > PCPU_AREA_CACHE_MAX_SIZE)
+		return -1;
+
+	cache = raw_cpu_ptr(&pcpu_area_cache);
+	raw_spin_lock_irqsave(&cache->lock, flags);
+	for (i = cache->nr - 1; i >= 0; i--) {
+		if (cache->areas[i].size != size ||
+		    !IS_ALIGNED(cache->areas[i].off, align))
+			continue;
+
+		*chunkp = cache->areas[i].chunk;
+		off = cache->areas[i].off;
+		cache->areas[i] = cache->areas[--cache->nr];
+		break;
+	}
+	raw_spin_unlock_irqrestore(&cache->lock, flags);
+
+	return off;
+}
+
+/**
+ * pcpu_area_cache_put - free an area to the local area cache
+ * @chunk: chunk of interest
+ * @off: offset of the area in @chunk
+ *
+ * RETURNS:
+ * %true if the area was cached and must not be freed to @chunk.
+ */
+static bool pcpu_area_cache_put(struct pcpu_chunk *chunk, int off)
+{
+	struct pcpu_area_cache *cache;
+	unsigned long flags;
+	int bit_off, size;
+
+	/* leave chunks that are being reclaimed alone */
+	if (chunk == pcpu_reserved_chunk || data_race(chunk->isolated))
+		return false;
+
+	/*
+	 * The boundary bits of the area can't change until it is freed, so
+	 * its size can be read without pcpu_lock.
+	 */
+	bit_off = off / PCPU_MIN_ALLOC_SIZE;
+	size = (data_race(find_next_bit(chunk->bound_map,
+					pcpu_chunk_map_bits(chunk),
+					bit_off + 1)) - bit_off) *
+	       PCPU_MIN_ALLOC_SIZE;
+	if (size > PCPU_AREA_CACHE_MAX_SIZE)
+		return false;
+
+	/*
+	 * Claim a slot before running the free hooks: once they ran, the
+	 * area must not go back through the regular free path, and once it
+	 * is in the cache, it may be reused.
+	 */
+	cache = raw_cpu_ptr(&pcpu_area_cache);
+	raw_spin_lock_irqsave(&cache->lock, flags);
+	if (cache->nr + cache->reserved >= PCPU_AREA_CACHE_NR) {
+		raw_spin_unlock_irqrestore(&cache->lock, flags);
+		return false;
+	}
+	cache->reserved++;
+	raw_spin_unlock_irqrestore(&cache->lock, flags);
+
+	pcpu_alloc_tag_free_hook(chunk, off, size);
+	pcpu_memcg_free_hook(chunk, off, size);
+
+	/* the claimed slot is in this cache, even if we migrated meanwhile */
+	raw_spin_lock_irqsave(&cache->lock, flags);
+	cache->reserved--;
+	cache->areas[cache->nr].chunk = chunk;
+	cache->areas[cache->nr].off = off;
+	cache->areas[cache->nr].size = size;
+	cache->nr++;
+	raw_spin_unlock_irqrestore(&cache->lock, flags);
+
+	return true;
+}
+
+/**
+ * pcpu_area_cache_drain - return all cached areas to their chunks
+ *
+ * CONTEXT:
+ * pcpu_lock.
+ */
+static void pcpu_area_cache_drain(void)
+{
+	struct pcpu_area_cache *cache;
+	int cpu, i;
+
+	lockdep_assert_held(&pcpu_lock);
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(&pcpu_area_cache, cpu);
+		raw_spin_lock(&cache->lock);
+		for (i = 0; i < cache->nr; i++)
+			pcpu_free_area(cache->areas[i].chunk,
+				       cache->areas[i].off);
+		cache->nr = 0;
+		raw_spin_unlock(&cache->lock);
+	}
+}
+
 /**
  * pcpu_alloc - the percpu allocator
  * @size: size of area to allocate in bytes
@@ -1784,6 +1934,12 @@ void __percpu *pcpu_alloc_noprof(size_t size, size_t align, bool reserved,
 	if (unlikely(!pcpu_memcg_pre_alloc_hook(size, gfp, &objcg)))
 		return NULL;
 
+	if (!reserved) {
+		off = pcpu_area_cache_get(size, align, &chunk);
+		if (off >= 0)
+			goto area_cached;
+	}
+
 	if (!is_atomic) {
 		/*
 		 * pcpu_balance_workfn() allocates memory under this mutex,
@@ -1894,6 +2050,7 @@ void __percpu *pcpu_alloc_noprof(size_t size, size_t align, bool reserved,
 	if (pcpu_nr_empty_pop_pages < PCPU_EMPTY_POP_PAGES_LOW)
 		pcpu_schedule_balance_work();
 
+area_cached:
 	/* clear the areas and return address relative to base address */
 	for_each_possible_cpu(cpu)
 		memset((void *)pcpu_chunk_addr(chunk, cpu, 0) + off, 0, size);
@@ -2207,6 +2364,7 @@ static void pcpu_balance_workfn(struct work_struct *work)
 	mutex_lock(&pcpu_alloc_mutex);
 	spin_lock_irq(&pcpu_lock);
 
+	pcpu_area_cache_drain();
 	pcpu_balance_free(false);
 	pcpu_reclaim_populated();
 	pcpu_balance_populated();
@@ -2242,6 +2400,11 @@ void free_percpu(void __percpu *ptr)
 	chunk = pcpu_chunk_addr_search(addr);
 	off = addr - chunk->base_addr;
 
+	if (pcpu_area_cache_put(chunk, off)) {
+		trace_percpu_free_percpu(chunk->base_addr, off, ptr);
+		return;
+	}
+
 	spin_lock_irqsave(&pcpu_lock, flags);
 	size = pcpu_free_area(chunk, off);
 
@@ -143,15 +143,110 @@ file_ra_state_init(struct file_ra_state *ra, struct address_space *mapping)
 }
 EXPORT_SYMBOL_GPL(file_ra_state_init);
 
+/*
+ * Readahead feedback.
+ *
+ * The readahead window is supposed to be submitted far enough ahead of the
+ * reader that the IO has completed by the time the reader gets there. How
+ * far that is depends on how fast the device is and how fast the files are
+ * consumed, which the fixed read_ahead_kb can't know.
+ *
+ * With ra_feedback enabled on a bdi, readers that still end up waiting for
+ * readahead IO report how long they waited. Every RA_FB_PERIOD, the average
+ * wait times the rate at which the bdi is read ahead gives the number of
+ * pages the window fell short by, and the window of the bdi grows by that
+ * much. Periods without stalls shrink it slowly back towards read_ahead_kb.
+ *
+ * The same rate picks the folio order: a folio that takes the device about
+ * a millisecond to read still doesn't hold readers up noticeably.
+ */
+#define RA_FB_PERIOD		(HZ / 10)
+#define RA_FB_MAX_SCALE		16
+
+static void ra_fb_update(struct backing_dev_info *bdi)
+{
+	struct bdi_ra_feedback *fb = &bdi->ra_fb;
+	unsigned long stamp = READ_ONCE(fb->stamp);
+	unsigned long elapsed = jiffies - stamp;
+	unsigned long pages, stall_ns, stall_us, window, min, max;
+	int stalls;
+
+	if (elapsed < RA_FB_PERIOD)
+		return;
+	if (cmpxchg(&fb->stamp, stamp, stamp + elapsed) != stamp)
+		return;
+
+	pages = atomic_long_xchg(&fb->pages, 0);
+	stall_ns = atomic_long_xchg(&fb->stall_ns, 0);
+	stalls = atomic_xchg(&fb->stalls, 0);
+
+	/* an idle bdi says nothing about its device */
+	if (!pages)
+		return;
+
+	WRITE_ONCE(fb->bandwidth, (3 * fb->bandwidth +
+				   pages * HZ / elapsed) / 4);
+	stall_us = stalls ? stall_ns / stalls / NSEC_PER_USEC : 0;
+	WRITE_ONCE(fb->stall_us, (3 * fb->stall_us + stall_us) / 4);
+
+	min = READ_ONCE(bdi->ra_pages);
+	max = min * RA_FB_MAX_SCALE;
+	window = max(fb->window, min);
+	if (stalls)
+		window += div_u64((u64)fb->bandwidth * fb->stall_us,
+				  USEC_PER_SEC);
+	else
+		window -= (window - min) / 8;
+	WRITE_ONCE(fb->window, clamp(window, min, max));
+}
+
+/* The controller's readahead window for @bdi, 0 if it doesn't have one. */
+static unsigned long ra_fb_window(struct backing_dev_info *bdi)
+{
+	if (!READ_ONCE(bdi->ra_fb.enabled))
+		return 0;
+	return READ_ONCE(bdi->ra_fb.window);
+}
+
+static unsigned int ra_fb_order(struct backing_dev_info *bdi)
+{
+	unsigned long pages_per_ms;
+
+	if (!READ_ONCE(bdi->ra_fb.enabled))
+		return 0;
+	pages_per_ms = READ_ONCE(bdi->ra_fb.bandwidth) / MSEC_PER_SEC;
+	return pages_per_ms ? ilog2(pages_per_ms) : 0;
+}
+
+/*
+ * A reader of @mapping waited @ns for a folio that was still being read,
+ * usually by readahead.
+ */
+void page_cache_ra_stall(struct address_space *mapping, u64 ns)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(mapping->host);
+
+	if (!READ_ONCE(bdi->ra_fb.enabled))
+		return;
+	atomic_long_add(ns, &bdi->ra_fb.stall_ns);
+	atomic_inc(&bdi->ra_fb.stalls);
+}
+
 static void read_pages(struct readahead_control *rac)
 {
 	const struct address_space_operations *aops = rac->mapping->a_ops;
+	struct backing_dev_info *bdi = inode_to_bdi(rac->mapping->host);
 	struct folio *folio;
 	struct blk_plug plug;
 
 	if (!readahead_count(rac))
 		return;
 
+	if (READ_ONCE(bdi->ra_fb.enabled)) {
+		atomic_long_add(readahead_count(rac), &bdi->ra_fb.pages);
+		ra_fb_update(bdi);
+	}
+
 	if (unlikely(rac->_workingset))
 		psi_memstall_enter(&rac->_pflags);
 	blk_start_plug(&plug);
@@ -473,6 +568,7 @@ void page_cache_ra_order(struct readahead_control *ractl,
 
 	if (new_order < mapping_max_folio_order(mapping))
 		new_order += 2;
+	new_order = max(new_order, ra_fb_order(inode_to_bdi(mapping->host)));
 
 	new_order = min(mapping_max_folio_order(mapping), new_order);
 	new_order = min_t(unsigned int, new_order, ilog2(ra->size));
@@ -523,7 +619,7 @@ static unsigned long ractl_max_pages(struct readahead_control *ractl,
 		unsigned long req_size)
 {
 	struct backing_dev_info *bdi = inode_to_bdi(ractl->mapping->host);
-	unsigned long max_pages = ractl->ra->ra_pages;
+	unsigned long max_pages = max(ractl->ra->ra_pages, ra_fb_window(bdi));
 
 	/*
 	 * If the request exceeds the readahead window, allow the read to
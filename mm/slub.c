@@ -373,6 +373,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	ALLOC_PCS,		/* Allocation from percpu sheaf */
+	FREE_PCS,		/* Free to percpu sheaf */
+	SHEAF_REFILL,		/* Percpu sheaf refilled from slabs */
+	SHEAF_FLUSH,		/* Percpu sheaf objects flushed to slabs */
 	NR_SLUB_STAT_ITEMS
 };
 
@@ -3252,6 +3256,221 @@ static inline void put_partials_cpu(struct kmem_cache *s,
 
 #endif	/* CONFIG_SLUB_CPU_PARTIAL */
 
+/*
+ * Percpu sheaves for SLAB_PERCPU_SHEAVES caches.
+ *
+ * Each cpu has one array of objects (a sheaf) protected by a local lock.
+ * Allocations pop from it and frees push to it, so neither touches the cpu
+ * slab. The lock disables interrupts on !PREEMPT_RT, as objects may be freed
+ * from irq context. An empty sheaf is refilled with half of its capacity through the
+ * bulk allocation path, a full sheaf gets its older half flushed through
+ * the bulk free path. Both run without the sheaf lock held. Objects in a
+ * sheaf are free as far as the memcg, KASAN and other hooks are concerned,
+ * but allocated as far as their slabs are concerned.
+ */
+#define SHEAF_MAX_CAPACITY	32
+
+struct slab_sheaf {
+	unsigned int size;
+	void *objects[];
+};
+
+struct slub_percpu_sheaves {
+	local_lock_t lock;
+	struct slab_sheaf *main;
+};
+
+static int ___kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags,
+				    int node, size_t size, void **p,
+				    bool kfence);
+static void __kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p);
+
+static void *alloc_from_pcs(struct kmem_cache *s, gfp_t gfp, int node)
+{
+	void *objects[SHEAF_MAX_CAPACITY / 2];
+	struct slab_sheaf *sheaf;
+	unsigned int batch, room;
+	unsigned long flags;
+	void *object;
+	int filled;
+
+	if (!s->cpu_sheaves)
+		return NULL;
+
+	if (node != NUMA_NO_NODE && node != numa_mem_id())
+		return NULL;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves)->main;
+	if (likely(sheaf->size)) {
+		object = sheaf->objects[--sheaf->size];
+		local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+		stat(s, ALLOC_PCS);
+		return object;
+	}
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	/*
+	 * KFENCE objects must not be cached, kfence_free() would never see
+	 * them, and neither should objects from remote nodes.
+	 */
+	batch = s->sheaf_capacity / 2;
+	filled = ___kmem_cache_alloc_bulk(s, gfp, numa_mem_id(), batch,
+					  objects, false);
+	if (!filled)
+		return NULL;
+
+	stat(s, SHEAF_REFILL);
+	object = objects[--filled];
+
+	/* We might have been preempted or migrated meanwhile */
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves)->main;
+	room = min_t(unsigned int, filled, s->sheaf_capacity - sheaf->size);
+	memcpy(&sheaf->objects[sheaf->size], objects, room * sizeof(void *));
+	sheaf->size += room;
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (unlikely(room < filled))
+		__kmem_cache_free_bulk(s, filled - room, &objects[room]);
+
+	return object;
+}
+
+/* Returns false if the object has to be freed the regular way */
+static bool free_to_pcs(struct kmem_cache *s, struct slab *slab, void *object)
+{
+	void *objects[SHEAF_MAX_CAPACITY / 2];
+	struct slab_sheaf *sheaf;
+	unsigned int batch = 0;
+	unsigned long flags;
+
+	if (!s->cpu_sheaves)
+		return false;
+
+	/* Keep the sheaves node local */
+	if (slab_nid(slab) != numa_mem_id())
+		return false;
+
+	/* KFENCE objects are freed through kfence_free() */
+	if (is_kfence_address(object))
+		return false;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves)->main;
+	if (unlikely(sheaf->size == s->sheaf_capacity)) {
+		/* Make room by flushing the older, likely cache cold half */
+		batch = s->sheaf_capacity / 2;
+		memcpy(objects, sheaf->objects, batch * sizeof(void *));
+		sheaf->size -= batch;
+		memmove(sheaf->objects, &sheaf->objects[batch],
+			sheaf->size * sizeof(void *));
+	}
+	sheaf->objects[sheaf->size++] = object;
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	stat(s, FREE_PCS);
+	if (batch) {
+		__kmem_cache_free_bulk(s, batch, objects);
+		stat(s, SHEAF_FLUSH);
+	}
+
+	return true;
+}
+
+/* Flush the sheaf of the current cpu, called with migration disabled */
+static void flush_pcs(struct kmem_cache *s)
+{
+	void *objects[SHEAF_MAX_CAPACITY];
+	struct slab_sheaf *sheaf;
+	unsigned long flags;
+	unsigned int size;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	local_lock_irqsave(&s->cpu_sheaves->lock, flags);
+	sheaf = this_cpu_ptr(s->cpu_sheaves)->main;
+	size = sheaf->size;
+	memcpy(objects, sheaf->objects, size * sizeof(void *));
+	sheaf->size = 0;
+	local_unlock_irqrestore(&s->cpu_sheaves->lock, flags);
+
+	if (size) {
+		__kmem_cache_free_bulk(s, size, objects);
+		stat(s, SHEAF_FLUSH);
+	}
+}
+
+/* Flush the sheaf of a dead cpu, nobody else can access it */
+static void flush_pcs_cpu(struct kmem_cache *s, int cpu)
+{
+	struct slab_sheaf *sheaf;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	sheaf = per_cpu_ptr(s->cpu_sheaves, cpu)->main;
+	__kmem_cache_free_bulk(s, sheaf->size, sheaf->objects);
+	sheaf->size = 0;
+}
+
+static bool has_pcs(int cpu, struct kmem_cache *s)
+{
+	return s->cpu_sheaves &&
+		READ_ONCE(per_cpu_ptr(s->cpu_sheaves, cpu)->main->size);
+}
+
+static void free_percpu_sheaves(struct kmem_cache *s)
+{
+	int cpu;
+
+	if (!s->cpu_sheaves)
+		return;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(s->cpu_sheaves, cpu)->main);
+
+	free_percpu(s->cpu_sheaves);
+	s->cpu_sheaves = NULL;
+}
+
+static int alloc_percpu_sheaves(struct kmem_cache *s)
+{
+	int cpu;
+
+	/* Sheaves would bypass the debug checks of the slow paths */
+	if (!(s->flags & SLAB_PERCPU_SHEAVES) || kmem_cache_debug(s) ||
+	    slab_state < UP)
+		return 1;
+
+	if (s->size <= 256)
+		s->sheaf_capacity = SHEAF_MAX_CAPACITY;
+	else if (s->size <= 1024)
+		s->sheaf_capacity = SHEAF_MAX_CAPACITY / 2;
+	else
+		s->sheaf_capacity = SHEAF_MAX_CAPACITY / 4;
+
+	s->cpu_sheaves = alloc_percpu(struct slub_percpu_sheaves);
+	if (!s->cpu_sheaves)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		struct slub_percpu_sheaves *pcs = per_cpu_ptr(s->cpu_sheaves, cpu);
+
+		local_lock_init(&pcs->lock);
+		pcs->main = kzalloc_node(struct_size(pcs->main, objects,
+						     s->sheaf_capacity),
+					 GFP_KERNEL, cpu_to_mem(cpu));
+		if (!pcs->main) {
+			free_percpu_sheaves(s);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 static inline void flush_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 {
 	unsigned long flags;
@@ -3291,6 +3510,7 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 	}
 
 	put_partials_cpu(s, c);
+	flush_pcs_cpu(s, cpu);
 }
 
 struct slub_flush_work {
@@ -3319,13 +3539,14 @@ static void flush_cpu_slab(struct work_struct *w)
 		flush_slab(s, c);
 
 	put_partials(s);
+	flush_pcs(s);
 }
 
 static bool has_cpu_slab(int cpu, struct kmem_cache *s)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->slab || slub_percpu_partial(c);
+	return c->slab || slub_percpu_partial(c) || has_pcs(cpu, s);
 }
 
 static DEFINE_MUTEX(flush_lock);
@@ -3384,6 +3605,15 @@ static int slub_cpu_dead(unsigned int cpu)
 }
 
 #else /* CONFIG_SLUB_TINY */
+static inline void *alloc_from_pcs(struct kmem_cache *s, gfp_t gfp, int node)
+{
+	return NULL;
+}
+static inline bool free_to_pcs(struct kmem_cache *s, struct slab *slab,
+			       void *object)
+{
+	return false;
+}
 static inline void flush_all_cpus_locked(struct kmem_cache *s) { }
 static inline void flush_all(struct kmem_cache *s) { }
 static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu) { }
@@ -4141,7 +4371,9 @@ static __fastpath_inline void *slab_alloc_node(struct kmem_cache *s, struct list
 	if (unlikely(object))
 		goto out;
 
-	object = __slab_alloc_node(s, gfpflags, node, addr, orig_size);
+	object = alloc_from_pcs(s, gfpflags, node);
+	if (!object)
+		object = __slab_alloc_node(s, gfpflags, node, addr, orig_size);
 
 	maybe_wipe_obj_freeptr(s, object);
 	init = slab_want_init_on_alloc(gfpflags, s);
@@ -4598,8 +4830,11 @@ void slab_free(struct kmem_cache *s, struct slab *slab, void *object,
 	memcg_slab_free_hook(s, slab, &object, 1);
 	alloc_tagging_slab_free_hook(s, slab, &object, 1);
 
-	if (likely(slab_free_hook(s, object, slab_want_init_on_free(s), false)))
+	if (likely(slab_free_hook(s, object, slab_want_init_on_free(s), false))) {
+		if (free_to_pcs(s, slab, object))
+			return;
 		do_slab_free(s, slab, object, object, 1, addr);
+	}
 }
 
 #ifdef CONFIG_MEMCG
@@ -4873,9 +5108,13 @@ void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
 EXPORT_SYMBOL(kmem_cache_free_bulk);
 
 #ifndef CONFIG_SLUB_TINY
+/*
+ * Objects are taken from @node if possible, @kfence allows objects to come
+ * from the KFENCE pool.
+ */
 static inline
-int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
-			    void **p)
+int ___kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, int node,
+			     size_t size, void **p, bool kfence)
 {
 	struct kmem_cache_cpu *c;
 	unsigned long irqflags;
@@ -4890,7 +5129,8 @@ int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	local_lock_irqsave(&s->cpu_slab->lock, irqflags);
 
 	for (i = 0; i < size; i++) {
-		void *object = kfence_alloc(s, s->object_size, flags);
+		void *object = kfence ? kfence_alloc(s, s->object_size, flags) :
+					NULL;
 
 		if (unlikely(object)) {
 			p[i] = object;
@@ -4898,7 +5138,7 @@ int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 		}
 
 		object = c->freelist;
-		if (unlikely(!object)) {
+		if (unlikely(!object || !node_match(c->slab, node))) {
 			/*
 			 * We may have removed an object from c->freelist using
 			 * the fastpath in the previous iteration; in that case,
@@ -4914,7 +5154,7 @@ int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 			 * Invoking slow path likely have side-effect
 			 * of re-populating per CPU c->freelist
 			 */
-			p[i] = ___slab_alloc(s, flags, NUMA_NO_NODE,
+			p[i] = ___slab_alloc(s, flags, node,
 					    _RET_IP_, c, s->object_size);
 			if (unlikely(!p[i]))
 				goto error;
@@ -4943,6 +5183,13 @@ int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
 	return 0;
 
 }
+
+static inline
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			    void **p)
+{
+	return ___kmem_cache_alloc_bulk(s, flags, NUMA_NO_NODE, size, p, true);
+}
 #else /* CONFIG_SLUB_TINY */
 static int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags,
 				   size_t size, void **p)
@@ -5167,7 +5414,7 @@ static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
 
 	init_kmem_cache_cpus(s);
 
-	return 1;
+	return alloc_percpu_sheaves(s);
 }
 #else
 static inline int alloc_kmem_cache_cpus(struct kmem_cache *s)
@@ -5236,6 +5483,7 @@ void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
 #ifndef CONFIG_SLUB_TINY
+	free_percpu_sheaves(s);
 	free_percpu(s->cpu_slab);
 #endif
 	free_kmem_cache_nodes(s);
@@ -6886,6 +7134,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(ALLOC_PCS, alloc_pcs);
+STAT_ATTR(FREE_PCS, free_pcs);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
 #endif	/* CONFIG_SLUB_STATS */
 
 #ifdef CONFIG_KFENCE
@@ -6973,6 +7225,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&alloc_pcs_attr.attr,
+	&free_pcs_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -636,7 +636,8 @@ static void lru_lazyfree(struct lruvec *lruvec, struct folio *folio)
 /*
  * Drain pages out of the cpu's folio_batch.
  * Either "cpu" is the current CPU, and preemption has already been
- * disabled; or "cpu" is being hot-unplugged, and is already dead.
+ * disabled; or "cpu" is being hot-unplugged, and is already dead; or
+ * on PREEMPT_RT, the caller holds the local lock instance of "cpu".
  */
 void lru_add_drain_cpu(int cpu)
 {
@@ -652,9 +653,15 @@ void lru_add_drain_cpu(int cpu)
 		unsigned long flags;
 
 		/* No harm done if a racing interrupt already did this */
-		local_lock_irqsave(&cpu_fbatches.lock_irq, flags);
-		folio_batch_move_lru(fbatch, lru_move_tail);
-		local_unlock_irqrestore(&cpu_fbatches.lock_irq, flags);
+		if (local_lock_remote_allowed()) {
+			local_lock_cpu(&cpu_fbatches.lock_irq, cpu);
+			folio_batch_move_lru(fbatch, lru_move_tail);
+			local_unlock_cpu(&cpu_fbatches.lock_irq, cpu);
+		} else {
+			local_lock_irqsave(&cpu_fbatches.lock_irq, flags);
+			folio_batch_move_lru(fbatch, lru_move_tail);
+			local_unlock_irqrestore(&cpu_fbatches.lock_irq, flags);
+		}
 	}
 
 	fbatch = &fbatches->lru_deactivate_file;
@@ -723,6 +730,24 @@ void folio_mark_lazyfree(struct folio *folio)
 	folio_batch_add_and_move(folio, lru_lazyfree, true);
 }
 
+/*
+ * Drain the folio batches, including the mlock batch, of another CPU.
+ * On PREEMPT_RT this is done under the local locks of "cpu", which may
+ * therefore still be online. Otherwise "cpu" must already be dead.
+ */
+void lru_add_drain_remote(int cpu)
+{
+	if (local_lock_remote_allowed()) {
+		local_lock_cpu(&cpu_fbatches.lock, cpu);
+		lru_add_drain_cpu(cpu);
+		local_unlock_cpu(&cpu_fbatches.lock, cpu);
+	} else {
+		WARN_ON_ONCE(cpu_online(cpu));
+		lru_add_drain_cpu(cpu);
+	}
+	mlock_drain_remote(cpu);
+}
+
 void lru_add_drain(void)
 {
 	local_lock(&cpu_fbatches.lock);
@@ -863,11 +888,25 @@ static inline void __lru_add_drain_all(bool force_all_cpus)
 	for_each_online_cpu(cpu) {
 		struct work_struct *work = &per_cpu(lru_add_drain_work, cpu);
 
-		if (cpu_needs_drain(cpu)) {
-			INIT_WORK(work, lru_add_drain_per_cpu);
-			queue_work_on(cpu, mm_percpu_wq, work);
-			__cpumask_set_cpu(cpu, &has_work);
+		if (!cpu_needs_drain(cpu))
+			continue;
+
+		/*
+		 * If the folio batches can be drained from here, don't wake
+		 * up a kworker on @cpu, which might be an isolated one. Only
+		 * the bh LRUs, which are protected by disabling preemption,
+		 * still have to be invalidated on @cpu itself. They are never
+		 * populated on isolated CPUs.
+		 */
+		if (local_lock_remote_allowed()) {
+			lru_add_drain_remote(cpu);
+			if (!has_bh_in_lru(cpu, NULL))
+				continue;
 		}
+
+		INIT_WORK(work, lru_add_drain_per_cpu);
+		queue_work_on(cpu, mm_percpu_wq, work);
+		__cpumask_set_cpu(cpu, &has_work);
 	}
 
 	for_each_cpu(cpu, &has_work)
@@ -62,6 +62,21 @@ static bool enable_vma_readahead __read_mostly = true;
 #define GET_SWAP_RA_VAL(vma)					\
 	(atomic_long_read(&(vma)->swap_readahead_info) ? : 4)
 
+/*
+ * swap_readahead_stride holds the distance in pages between the last two
+ * swap faults of a vma, and in its low bits how many times in a row that
+ * distance repeated. Once it is confirmed, the readahead follows the
+ * stride instead of reading around the fault.
+ */
+#define SWAP_RA_CONF_MAX	3
+#define SWAP_RA_CONFIRMED	2
+#define SWAP_RA_STRIDE_WIN	4
+
+#define SWAP_RA_CONF(v)		((v) & SWAP_RA_CONF_MAX)
+#define SWAP_RA_STRIDE(v)	(((v) - SWAP_RA_CONF(v)) / (SWAP_RA_CONF_MAX + 1))
+#define SWAP_RA_STRIDE_VAL(stride, conf)			\
+	((long)(stride) * (SWAP_RA_CONF_MAX + 1) + (conf))
+
 static atomic_t swapin_readahead_hits = ATOMIC_INIT(4);
 
 void show_swap_cache_info(void)
@@ -160,6 +175,9 @@ void __delete_from_swap_cache(struct folio *folio,
 		VM_BUG_ON_PAGE(entry != folio, entry);
 		xas_next(&xas);
 	}
+	/* readahead that was never used */
+	if (folio_test_readahead(folio))
+		count_vm_events(SWAP_RA_MISS, nr);
 	folio->swap.val = 0;
 	folio_clear_swapcache(folio);
 	address_space->nrpages -= nr;
@@ -742,12 +760,41 @@ void exit_swap_address_space(unsigned int type)
 	swapper_spaces[type] = NULL;
 }
 
+/*
+ * Learn the stride between the swap faults of @vma. Returns the stride in
+ * pages if it repeated often enough to follow it, 0 otherwise.
+ */
+static long swap_vma_ra_stride(struct vm_area_struct *vma,
+			       unsigned long prev_faddr, unsigned long faddr)
+{
+	long stride_val = atomic_long_read(&vma->swap_readahead_stride);
+	long delta = (long)PFN_DOWN(faddr) - (long)PFN_DOWN(prev_faddr);
+	unsigned int conf = SWAP_RA_CONF(stride_val);
+
+	/* only strides that keep the readahead within one page table */
+	if (!delta || abs(delta) >= PTRS_PER_PTE)
+		delta = 0;
+
+	if (delta && delta == SWAP_RA_STRIDE(stride_val))
+		conf = min_t(unsigned int, conf + 1, SWAP_RA_CONF_MAX);
+	else
+		conf = 0;
+	atomic_long_set(&vma->swap_readahead_stride,
+			SWAP_RA_STRIDE_VAL(delta, conf));
+
+	return conf >= SWAP_RA_CONFIRMED ? delta : 0;
+}
+
+/*
+ * Work out the readahead window around the fault: *@nr pages, starting at
+ * *@start and @stride pages apart.
+ */
 static int swap_vma_ra_win(struct vm_fault *vmf, unsigned long *start,
-			   unsigned long *end)
+			   unsigned long *nr, long *stride)
 {
 	struct vm_area_struct *vma = vmf->vma;
 	unsigned long ra_val;
-	unsigned long faddr, prev_faddr, left, right;
+	unsigned long faddr, prev_faddr, left, right, lo, hi;
 	unsigned int max_win, hits, prev_win, win;
 
 	max_win = 1 << min(READ_ONCE(page_cluster), SWAP_RA_ORDER_CEILING);
@@ -761,6 +808,34 @@ static int swap_vma_ra_win(struct vm_fault *vmf, unsigned long *start,
 	hits = SWAP_RA_HITS(ra_val);
 	win = __swapin_nr_pages(PFN_DOWN(prev_faddr), PFN_DOWN(faddr), hits,
 				max_win, prev_win);
+
+	lo = max(vma->vm_start, faddr & PMD_MASK);
+	hi = min(vma->vm_end, (faddr & PMD_MASK) + PMD_SIZE);
+
+	*stride = swap_vma_ra_stride(vma, prev_faddr, faddr);
+	if (abs(*stride) > 1) {
+		/*
+		 * A strided pattern doesn't produce adjacent faults, so the
+		 * window would never open up by itself.
+		 */
+		win = max(win, min_t(unsigned int, SWAP_RA_STRIDE_WIN, max_win));
+		atomic_long_set(&vma->swap_readahead_info,
+				SWAP_RA_VAL(faddr, win, 0));
+
+		*start = faddr;
+		*nr = 1;
+		while (*nr < win) {
+			unsigned long next = faddr + *nr * *stride * PAGE_SIZE;
+
+			if (next < lo || next >= hi)
+				break;
+			(*nr)++;
+		}
+		if (*nr > 1)
+			count_vm_event(SWAP_RA_STRIDE);
+		return *nr;
+	}
+
 	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(faddr, win, 0));
 	if (win == 1)
 		return 1;
@@ -774,8 +849,9 @@ static int swap_vma_ra_win(struct vm_fault *vmf, unsigned long *start,
 	right = left + (win << PAGE_SHIFT);
 	if ((long)left < 0)
 		left = 0;
-	*start = max3(left, vma->vm_start, faddr & PMD_MASK);
-	*end = min3(right, vma->vm_end, (faddr & PMD_MASK) + PMD_SIZE);
+	*start = max(left, lo);
+	*nr = PFN_DOWN(min(right, hi) - *start);
+	*stride = 1;
 
 	return win;
 }
@@ -791,7 +867,9 @@ static int swap_vma_ra_win(struct vm_fault *vmf, unsigned long *start,
  * Returns the struct folio for entry and addr, after queueing swapin.
  *
  * Primitive swap readahead code. We simply read in a few pages whose
- * virtual addresses are around the fault address in the same vma.
+ * virtual addresses are around the fault address in the same vma, or, if
+ * the faults of the vma follow a fixed stride, the next few pages along
+ * that stride.
  *
  * Caller must hold read mmap_lock if vmf->vma is not NULL.
  *
@@ -804,23 +882,28 @@ static struct folio *swap_vma_readahead(swp_entry_t targ_entry, gfp_t gfp_mask,
 	struct folio *folio;
 	pte_t *pte = NULL, pentry;
 	int win;
-	unsigned long start, end, addr;
+	unsigned long start, nr, addr, i;
+	long stride;
 	swp_entry_t entry;
 	pgoff_t ilx;
 	bool page_allocated;
 
-	win = swap_vma_ra_win(vmf, &start, &end);
+	win = swap_vma_ra_win(vmf, &start, &nr, &stride);
 	if (win == 1)
 		goto skip;
 
 	ilx = targ_ilx - PFN_DOWN(vmf->address - start);
 
 	blk_start_plug(&plug);
-	for (addr = start; addr < end; ilx++, addr += PAGE_SIZE) {
-		if (!pte++) {
+	for (i = 0, addr = start; i < nr;
+	     i++, ilx += stride, addr += stride * PAGE_SIZE) {
+		/* all of the window is in the page table of the fault */
+		if (!pte) {
 			pte = pte_offset_map(vmf->pmd, addr);
 			if (!pte)
 				break;
+		} else {
+			pte += stride;
 		}
 		pentry = ptep_get_lockless(pte);
 		if (!is_swap_pte(pentry))
@@ -2607,6 +2607,13 @@ static int setup_swap_extents(struct swap_info_struct *sis, sector_t *span)
 	struct inode *inode = mapping->host;
 	int ret;
 
+	/*
+	 * Block device reads only use the pool for batching readahead, and
+	 * fall back to one bio per folio without it.
+	 */
+	if (!(sis->flags & SWP_FS_OPS))
+		sio_pool_init();
+
 	if (S_ISBLK(inode->i_mode)) {
 		ret = add_swap_extent(sis, 0, sis->max, 0);
 		*span = sis->pages;
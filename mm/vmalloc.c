@@ -40,6 +40,7 @@
 #include <linux/pgtable.h>
 #include <linux/hugetlb.h>
 #include <linux/sched/mm.h>
+#include <linux/context_tracking_state.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
 #include <linux/page_owner.h>
@@ -2109,6 +2110,91 @@ static atomic_long_t vmap_lazy_nr = ATOMIC_LONG_INIT(0);
  */
 static DEFINE_MUTEX(vmap_purge_lock);
 
+#ifdef CONFIG_VMALLOC_DEFER_FLUSH
+/*
+ * Kernel TLB generation, bumped by every purge flush. nohz_full CPUs that
+ * are in userspace when a purge flushes are left out of the IPI and flush
+ * their whole kernel TLB on their next kernel entry, when they find they
+ * have not seen the current generation yet. NMIs taken in userspace do
+ * the same from ct_nmi_enter(), and a CPU with RCU watching is treated as
+ * being in the kernel even if its context tracking state is still user.
+ *
+ * The generation bump is fully ordered before reading the remote context
+ * tracking state, and ct_kernel_enter() is fully ordered before the entry
+ * path reads the generation, so either the CPU is seen in the kernel and
+ * gets an IPI, or it sees the new generation and flushes by itself.
+ *
+ * A nohz_full CPU that takes the IPI and had already seen the previous
+ * generation is up to date after it, so the purger advances its seen
+ * generation rather than have it flush everything on its next entry.
+ */
+static atomic_long_t kernel_tlb_gen = ATOMIC_LONG_INIT(0);
+static DEFINE_PER_CPU(long, kernel_tlb_gen_seen);
+
+/* Protected by vmap_purge_lock. */
+static struct cpumask vmap_flush_mask;
+
+/*
+ * Called with interrupts disabled on kernel entry from userspace, possibly
+ * from NMI context.
+ */
+void vmalloc_flush_deferred(void)
+{
+	long gen = atomic_long_read(&kernel_tlb_gen);
+
+	if (likely(__this_cpu_read(kernel_tlb_gen_seen) == gen))
+		return;
+
+	__this_cpu_write(kernel_tlb_gen_seen, gen);
+	__flush_tlb_all();
+	count_vm_event(VMAP_FLUSH_ON_ENTRY);
+}
+
+static void vmap_flush_tlb_kernel_range(unsigned long start, unsigned long end)
+{
+	struct cpumask *mask = &vmap_flush_mask;
+	unsigned int deferred = 0;
+	long gen;
+	int cpu;
+
+	lockdep_assert_held(&vmap_purge_lock);
+
+	if (!context_tracking_enabled()) {
+		flush_tlb_kernel_range(start, end);
+		count_vm_events(VMAP_FLUSH_IMMEDIATE, num_online_cpus());
+		return;
+	}
+
+	gen = atomic_long_inc_return(&kernel_tlb_gen);
+
+	cpumask_copy(mask, cpu_online_mask);
+	for_each_cpu(cpu, mask) {
+		if (context_tracking_enabled_cpu(cpu) &&
+		    ct_state_cpu(cpu) == CT_STATE_USER &&
+		    !(ct_rcu_watching_cpu(cpu) & CT_RCU_WATCHING)) {
+			cpumask_clear_cpu(cpu, mask);
+			deferred++;
+		}
+	}
+
+	flush_tlb_kernel_range_mask(start, end, mask);
+
+	for_each_cpu(cpu, mask) {
+		if (context_tracking_enabled_cpu(cpu))
+			cmpxchg(per_cpu_ptr(&kernel_tlb_gen_seen, cpu),
+				gen - 1, gen);
+	}
+
+	count_vm_events(VMAP_FLUSH_IMMEDIATE, cpumask_weight(mask));
+	count_vm_events(VMAP_FLUSH_DEFERRED, deferred);
+}
+#else
+static void vmap_flush_tlb_kernel_range(unsigned long start, unsigned long end)
+{
+	flush_tlb_kernel_range(start, end);
+}
+#endif
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 static cpumask_t purge_nodes;
@@ -2281,7 +2367,7 @@ static bool __purge_vmap_area_lazy(unsigned long start, unsigned long end,
 
 	nr_purge_nodes = cpumask_weight(&purge_nodes);
 	if (nr_purge_nodes > 0) {
-		flush_tlb_kernel_range(start, end);
+		vmap_flush_tlb_kernel_range(start, end);
 
 		/* One extra worker is per a lazy_max_pages() full set minus one. */
 		nr_purge_helpers = atomic_long_read(&vmap_lazy_nr) / lazy_max_pages();
@@ -2897,7 +2983,7 @@ static void _vm_unmap_aliases(unsigned long start, unsigned long end, int flush)
 	free_purged_blocks(&purge_list);
 
 	if (!__purge_vmap_area_lazy(start, end, false) && flush)
-		flush_tlb_kernel_range(start, end);
+		vmap_flush_tlb_kernel_range(start, end);
 	mutex_unlock(&vmap_purge_lock);
 }
 
@@ -14,6 +14,7 @@
 
 #include <linux/mm.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/rt.h>
 #include <linux/module.h>
 #include <linux/gfp.h>
 #include <linux/kernel_stat.h>
@@ -4719,11 +4720,65 @@ static bool should_run_aging(struct lruvec *lruvec, unsigned long max_seq,
 	return false;
 }
 
+/* RT and deadline tasks must not stall in direct reclaim for long */
+static bool reclaimer_is_rt(void)
+{
+	return !current_is_kswapd() && rt_or_dl_task(current);
+}
+
+static struct workqueue_struct *lru_gen_age_wq __read_mostly;
+
+static void lru_gen_age_workfn(struct work_struct *work)
+{
+	struct lru_gen_folio *lrugen = container_of(work, struct lru_gen_folio,
+						    age_work);
+	struct lruvec *lruvec = container_of(lrugen, struct lruvec, lrugen);
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	unsigned long nr_to_scan;
+	unsigned int flags;
+	int swappiness;
+	struct scan_control sc = {
+		.may_writepage = true,
+		.may_unmap = true,
+		.may_swap = true,
+		.reclaim_idx = MAX_NR_ZONES - 1,
+		.gfp_mask = GFP_KERNEL,
+	};
+	DEFINE_MAX_SEQ(lruvec);
+
+	set_task_reclaim_state(current, &sc.reclaim_state);
+	flags = memalloc_noreclaim_save();
+	set_mm_walk(NULL, true);
+
+	swappiness = get_swappiness(lruvec, &sc);
+	if (should_run_aging(lruvec, max_seq, swappiness, &nr_to_scan))
+		try_to_inc_max_seq(lruvec, max_seq, swappiness, false);
+
+	clear_mm_walk();
+	memalloc_noreclaim_restore(flags);
+	set_task_reclaim_state(current, NULL);
+
+	mem_cgroup_put(memcg);
+}
+
 /*
- * For future optimizations:
- * 1. Defer try_to_inc_max_seq() to workqueues to reduce latency for memcg
- *    reclaim.
+ * Direct reclaim hands the aging, i.e., the page table walks, to
+ * lru_gen_age_wq. Its workers are unbound and thus stay on housekeeping
+ * CPUs. Returns false if the caller has to age @lruvec itself.
  */
+static bool lru_gen_queue_aging(struct lruvec *lruvec)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+
+	if (!lru_gen_age_wq || !mem_cgroup_tryget(memcg))
+		return false;
+
+	if (!queue_work(lru_gen_age_wq, &lruvec->lrugen.age_work))
+		mem_cgroup_put(memcg);
+
+	return true;
+}
+
 static long get_nr_to_scan(struct lruvec *lruvec, struct scan_control *sc, bool can_swap)
 {
 	bool success;
@@ -4745,7 +4800,16 @@ static long get_nr_to_scan(struct lruvec *lruvec, struct scan_control *sc, bool
 		return nr_to_scan >> sc->priority;
 
 	/* stop scanning this lruvec as it's low on cold folios */
-	return try_to_inc_max_seq(lruvec, max_seq, can_swap, false) ? -1 : 0;
+	if (current_is_kswapd() || !lru_gen_queue_aging(lruvec))
+		return try_to_inc_max_seq(lruvec, max_seq, can_swap, false) ? -1 : 0;
+
+	/* RT and deadline tasks move on to other lruvecs without waiting */
+	if (reclaimer_is_rt())
+		return 0;
+
+	flush_work(&lruvec->lrugen.age_work);
+
+	return READ_ONCE(lruvec->lrugen.max_seq) > max_seq ? -1 : 0;
 }
 
 static bool should_abort_scan(struct lruvec *lruvec, struct scan_control *sc)
@@ -4784,6 +4848,7 @@ static bool try_to_shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 	long nr_to_scan;
 	unsigned long scanned = 0;
 	int swappiness = get_swappiness(lruvec, sc);
+	bool bounded = reclaimer_is_rt();
 
 	while (true) {
 		int delta;
@@ -4792,6 +4857,10 @@ static bool try_to_shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 		if (nr_to_scan <= 0)
 			break;
 
+		/* evict at most one batch of already aged folios */
+		if (bounded)
+			nr_to_scan = min_t(long, nr_to_scan, MAX_LRU_BATCH);
+
 		delta = evict_folios(lruvec, sc, swappiness);
 		if (!delta)
 			break;
@@ -5597,6 +5666,8 @@ void lru_gen_init_lruvec(struct lruvec *lruvec)
 	for_each_gen_type_zone(gen, type, zone)
 		INIT_LIST_HEAD(&lrugen->folios[gen][type][zone]);
 
+	INIT_WORK(&lrugen->age_work, lru_gen_age_workfn);
+
 	if (mm_state)
 		mm_state->seq = MIN_NR_GENS;
 }
@@ -5651,6 +5722,11 @@ static int __init init_lru_gen(void)
 	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
 		pr_err("lru_gen: failed to create sysfs group\n");
 
+	lru_gen_age_wq = alloc_workqueue("lru_gen_age",
+					 WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (!lru_gen_age_wq)
+		pr_err("lru_gen: failed to create aging workqueue\n");
+
 	debugfs_create_file("lru_gen", 0644, NULL, NULL, &lru_gen_rw_fops);
 	debugfs_create_file("lru_gen_full", 0444, NULL, NULL, &lru_gen_ro_fops);
 
@@ -6490,6 +6566,7 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 				gfp_t gfp_mask, nodemask_t *nodemask)
 {
 	unsigned long nr_reclaimed;
+	u64 start;
 	struct scan_control sc = {
 		.nr_to_reclaim = SWAP_CLUSTER_MAX,
 		.gfp_mask = current_gfp_context(gfp_mask),
@@ -6520,9 +6597,11 @@ unsigned long try_to_free_pages(struct zonelist *zonelist, int order,
 
 	set_task_reclaim_state(current, &sc.reclaim_state);
 	trace_mm_vmscan_direct_reclaim_begin(order, sc.gfp_mask);
+	start = ktime_get_ns();
 
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
 
+	mem_cgroup_record_reclaim_latency(NULL, ktime_get_ns() - start);
 	trace_mm_vmscan_direct_reclaim_end(nr_reclaimed);
 	set_task_reclaim_state(current, NULL);
 
@@ -6579,6 +6658,7 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 {
 	unsigned long nr_reclaimed;
 	unsigned int noreclaim_flag;
+	u64 start;
 	struct scan_control sc = {
 		.nr_to_reclaim = max(nr_pages, SWAP_CLUSTER_MAX),
 		.proactive_swappiness = swappiness,
@@ -6602,9 +6682,13 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 	set_task_reclaim_state(current, &sc.reclaim_state);
 	trace_mm_vmscan_memcg_reclaim_begin(0, sc.gfp_mask);
 	noreclaim_flag = memalloc_noreclaim_save();
+	start = ktime_get_ns();
 
 	nr_reclaimed = do_try_to_free_pages(zonelist, &sc);
 
+	if (!sc.proactive)
+		mem_cgroup_record_reclaim_latency(memcg,
+						  ktime_get_ns() - start);
 	memalloc_noreclaim_restore(noreclaim_flag);
 	trace_mm_vmscan_memcg_reclaim_end(nr_reclaimed);
 	set_task_reclaim_state(current, NULL);
@@ -334,6 +334,25 @@ void set_pgdat_percpu_threshold(pg_data_t *pgdat,
 	}
 }
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+/*
+ * vmstat_shepherd folds the differentials of isolated CPUs remotely, so every
+ * update of a differential has to be atomic against other CPUs as well, not
+ * only against the local one. The non-atomic __mod_*() variants below are
+ * routed through the cmpxchg based mod_*_state() helpers.
+ */
+#define vmstat_diff_try_cmpxchg(p, po, n)	try_cmpxchg(raw_cpu_ptr(p), po, n)
+#define vmstat_diff_xchg(p, n)			xchg(raw_cpu_ptr(p), n)
+
+static inline void mod_zone_state(struct zone *zone,
+       enum zone_stat_item item, long delta, int overstep_mode);
+static inline void mod_node_state(struct pglist_data *pgdat,
+       enum node_stat_item item, int delta, int overstep_mode);
+#else
+#define vmstat_diff_try_cmpxchg(p, po, n)	this_cpu_try_cmpxchg(*(p), po, n)
+#define vmstat_diff_xchg(p, n)			this_cpu_xchg(*(p), n)
+#endif
+
 /*
  * For use when we know that interrupts are disabled,
  * or when we know that preemption is disabled and that
@@ -347,6 +366,11 @@ void __mod_zone_page_state(struct zone *zone, enum zone_stat_item item,
 	long x;
 	long t;
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_zone_state(zone, item, delta, 0);
+	return;
+#endif
+
 	/*
 	 * Accurate vmstat updates require a RMW. On !PREEMPT_RT kernels,
 	 * atomicity is provided by IRQs being disabled -- either explicitly
@@ -378,6 +402,11 @@ void __mod_node_page_state(struct pglist_data *pgdat, enum node_stat_item item,
 	long x;
 	long t;
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_node_state(pgdat, item, delta, 0);
+	return;
+#endif
+
 	if (vmstat_item_in_bytes(item)) {
 		/*
 		 * Only cgroups use subpage accounting right now; at
@@ -435,6 +464,11 @@ void __inc_zone_state(struct zone *zone, enum zone_stat_item item)
 	s8 __percpu *p = pcp->vm_stat_diff + item;
 	s8 v, t;
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_zone_state(zone, item, 1, 1);
+	return;
+#endif
+
 	/* See __mod_node_page_state */
 	preempt_disable_nested();
 
@@ -458,6 +492,11 @@ void __inc_node_state(struct pglist_data *pgdat, enum node_stat_item item)
 
 	VM_WARN_ON_ONCE(vmstat_item_in_bytes(item));
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_node_state(pgdat, item, 1, 1);
+	return;
+#endif
+
 	/* See __mod_node_page_state */
 	preempt_disable_nested();
 
@@ -491,6 +530,11 @@ void __dec_zone_state(struct zone *zone, enum zone_stat_item item)
 	s8 __percpu *p = pcp->vm_stat_diff + item;
 	s8 v, t;
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_zone_state(zone, item, -1, -1);
+	return;
+#endif
+
 	/* See __mod_node_page_state */
 	preempt_disable_nested();
 
@@ -514,6 +558,11 @@ void __dec_node_state(struct pglist_data *pgdat, enum node_stat_item item)
 
 	VM_WARN_ON_ONCE(vmstat_item_in_bytes(item));
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	mod_node_state(pgdat, item, -1, -1);
+	return;
+#endif
+
 	/* See __mod_node_page_state */
 	preempt_disable_nested();
 
@@ -587,7 +636,7 @@ static inline void mod_zone_state(struct zone *zone,
 			z = n + os;
 			n = -os;
 		}
-	} while (!this_cpu_try_cmpxchg(*p, &o, n));
+	} while (!vmstat_diff_try_cmpxchg(p, &o, n));
 
 	if (z)
 		zone_page_state_add(z, zone, item);
@@ -656,7 +705,7 @@ static inline void mod_node_state(struct pglist_data *pgdat,
 			z = n + os;
 			n = -os;
 		}
-	} while (!this_cpu_try_cmpxchg(*p, &o, n));
+	} while (!vmstat_diff_try_cmpxchg(p, &o, n));
 
 	if (z)
 		node_page_state_add(z, pgdat, item);
@@ -821,7 +870,7 @@ static int refresh_cpu_vm_stats(bool do_pagesets)
 		for (i = 0; i < NR_VM_ZONE_STAT_ITEMS; i++) {
 			int v;
 
-			v = this_cpu_xchg(pzstats->vm_stat_diff[i], 0);
+			v = vmstat_diff_xchg(&pzstats->vm_stat_diff[i], 0);
 			if (v) {
 
 				atomic_long_add(v, &zone->vm_stat[i]);
@@ -876,7 +925,7 @@ static int refresh_cpu_vm_stats(bool do_pagesets)
 		for (i = 0; i < NR_VM_NODE_STAT_ITEMS; i++) {
 			int v;
 
-			v = this_cpu_xchg(p->vm_node_stat_diff[i], 0);
+			v = vmstat_diff_xchg(&p->vm_node_stat_diff[i], 0);
 			if (v) {
 				atomic_long_add(v, &pgdat->vm_stat[i]);
 				global_node_diff[i] += v;
@@ -948,6 +997,63 @@ void cpu_vm_stats_fold(int cpu)
 	fold_diff(global_zone_diff, global_node_diff);
 }
 
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+/*
+ * Fold the differentials of an online cpu from another cpu. This is only
+ * safe because all updates of the differentials are atomic, see
+ * vmstat_diff_try_cmpxchg(). Unlike refresh_cpu_vm_stats(), the pagesets
+ * of the remote cpu are left alone.
+ */
+static void refresh_cpu_vm_stats_remote(int cpu)
+{
+	struct pglist_data *pgdat;
+	struct zone *zone;
+	int i;
+	int global_zone_diff[NR_VM_ZONE_STAT_ITEMS] = { 0, };
+	int global_node_diff[NR_VM_NODE_STAT_ITEMS] = { 0, };
+
+	for_each_populated_zone(zone) {
+		struct per_cpu_zonestat *pzstats;
+
+		pzstats = per_cpu_ptr(zone->per_cpu_zonestats, cpu);
+
+		for (i = 0; i < NR_VM_ZONE_STAT_ITEMS; i++) {
+			int v;
+
+			if (!READ_ONCE(pzstats->vm_stat_diff[i]))
+				continue;
+
+			v = xchg(&pzstats->vm_stat_diff[i], 0);
+			if (v) {
+				atomic_long_add(v, &zone->vm_stat[i]);
+				global_zone_diff[i] += v;
+			}
+		}
+	}
+
+	for_each_online_pgdat(pgdat) {
+		struct per_cpu_nodestat *p;
+
+		p = per_cpu_ptr(pgdat->per_cpu_nodestats, cpu);
+
+		for (i = 0; i < NR_VM_NODE_STAT_ITEMS; i++) {
+			int v;
+
+			if (!READ_ONCE(p->vm_node_stat_diff[i]))
+				continue;
+
+			v = xchg(&p->vm_node_stat_diff[i], 0);
+			if (v) {
+				atomic_long_add(v, &pgdat->vm_stat[i]);
+				global_node_diff[i] += v;
+			}
+		}
+	}
+
+	fold_diff(global_zone_diff, global_node_diff);
+}
+#endif
+
 /*
  * this is only called if !populated_zone(zone), which implies no other users of
  * pset->vm_stat_diff[] exist.
@@ -1354,6 +1460,7 @@ const char * const vmstat_text[] = {
 	"compact_daemon_wake",
 	"compact_daemon_migrate_scanned",
 	"compact_daemon_free_scanned",
+	"compact_rt_skipped",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -1415,6 +1522,8 @@ const char * const vmstat_text[] = {
 #ifdef CONFIG_SWAP
 	"swap_ra",
 	"swap_ra_hit",
+	"swap_ra_miss",
+	"swap_ra_stride",
 	"swpin_zero",
 	"swpout_zero",
 #ifdef CONFIG_KSM
@@ -1433,11 +1542,33 @@ const char * const vmstat_text[] = {
 	"direct_map_level2_splits",
 	"direct_map_level3_splits",
 #endif
+#ifdef CONFIG_MEMCG
+	"memcg_stock_hit",
+	"memcg_stock_miss",
+	"memcg_stock_evict",
+	"memcg_obj_stock_hit",
+	"memcg_obj_stock_miss",
+#endif
 #ifdef CONFIG_PER_VMA_LOCK_STATS
 	"vma_lock_success",
 	"vma_lock_abort",
 	"vma_lock_retry",
 	"vma_lock_miss",
+	"vma_lock_fallback_fault",
+	"vma_lock_fallback_anon",
+	"vma_lock_fallback_device",
+	"vma_lock_madvise",
+#endif
+#ifdef CONFIG_VMALLOC_DEFER_FLUSH
+	"vmap_flush_immediate",
+	"vmap_flush_deferred",
+	"vmap_flush_on_entry",
+#endif
+#ifdef CONFIG_SMP
+	"vmstat_local_work",
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+	"vmstat_remote_fold",
+#endif
 #endif
 #ifdef CONFIG_DEBUG_STACK_USAGE
 	"kstack_1k",
@@ -2000,7 +2131,14 @@ int vmstat_refresh(const struct ctl_table *table, int write,
 
 static void vmstat_update(struct work_struct *w)
 {
+	count_vm_event(VMSTAT_LOCAL_WORK);
+
 	if (refresh_cpu_vm_stats(true)) {
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+		/* vmstat_shepherd takes over for isolated CPUs */
+		if (cpu_is_isolated(smp_processor_id()))
+			return;
+#endif
 		/*
 		 * Counters were updated so we expect more updates
 		 * to occur in the future. Keep on running the
@@ -2095,9 +2233,17 @@ static void vmstat_shepherd(struct work_struct *w)
 		 * been isolated from the kernel interference without critical
 		 * infrastructure ever noticing. Skip regular flushing from vmstat_shepherd
 		 * for all isolated CPUs to avoid interference with the isolated workload.
+		 * If the differentials can be folded remotely, do that from here instead.
 		 */
-		if (cpu_is_isolated(cpu))
+		if (cpu_is_isolated(cpu)) {
+#ifdef CONFIG_VMSTAT_REMOTE_FOLD
+			if (need_update(cpu)) {
+				refresh_cpu_vm_stats_remote(cpu);
+				count_vm_event(VMSTAT_REMOTE_FOLD);
+			}
+#endif
 			continue;
+		}
 
 		if (!delayed_work_pending(dw) && need_update(cpu))
 			queue_delayed_work_on(cpu, mm_percpu_wq, dw, 0);
@@ -36,7 +36,12 @@
  *	page_lock
  *	pool->migrate_lock
  *	class->lock
- *	zspage->lock
+ *	zspage->zsl.lock
+ *
+ * zs_map_object() takes none of pool->migrate_lock and class->lock. It
+ * resolves the handle under pool->migrate_seq and RCU (zspages are
+ * SLAB_TYPESAFE_BY_RCU) and then pins the zspage with a reader reference
+ * on zspage->zsl, which writers only ever trylock.
  */
 
 #include <linux/module.h>
@@ -65,6 +70,8 @@
 #include <linux/pagemap.h>
 #include <linux/fs.h>
 #include <linux/local_lock.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
 
 #define ZSPAGE_MAGIC	0x58
 
@@ -240,9 +247,25 @@ struct zs_pool {
 #endif
 	/* protect page/zspage migration */
 	rwlock_t migrate_lock;
+	/* bumped by migration and compaction, for lockless handle lookup */
+	seqcount_rwlock_t migrate_seq;
 	atomic_t compaction_in_progress;
 };
 
+#define ZS_PAGE_UNLOCKED	0
+#define ZS_PAGE_WRLOCKED	-1
+
+/*
+ * Readers (object mappers) only hold @lock long enough to adjust @cnt and
+ * may sleep while holding their reference. Writers (migration, compaction)
+ * must never wait for readers, so they only trylock and keep @lock held
+ * for the duration of the write section.
+ */
+struct zspage_lock {
+	spinlock_t lock;
+	int cnt;
+};
+
 struct zspage {
 	struct {
 		unsigned int huge:HUGE_BITS;
@@ -255,7 +278,8 @@ struct zspage {
 	struct page *first_page;
 	struct list_head list; /* fullness list */
 	struct zs_pool *pool;
-	rwlock_t lock;
+	/* initialised by the slab constructor, must stay last */
+	struct zspage_lock zsl;
 };
 
 struct mapping_area {
@@ -276,11 +300,11 @@ static bool ZsHugePage(struct zspage *zspage)
 	return zspage->huge;
 }
 
-static void migrate_lock_init(struct zspage *zspage);
-static void migrate_read_lock(struct zspage *zspage);
-static void migrate_read_unlock(struct zspage *zspage);
-static void migrate_write_lock(struct zspage *zspage);
-static void migrate_write_unlock(struct zspage *zspage);
+static void zspage_lock_init(void *ptr);
+static void zspage_read_lock(struct zspage *zspage);
+static void zspage_read_unlock(struct zspage *zspage);
+static bool zspage_write_trylock(struct zspage *zspage);
+static void zspage_write_unlock(struct zspage *zspage);
 
 #ifdef CONFIG_COMPACTION
 static void kick_deferred_free(struct zs_pool *pool);
@@ -308,8 +332,14 @@ static int create_cache(struct zs_pool *pool)
 	name = kasprintf(GFP_KERNEL, "zspage-%s", pool->name);
 	if (!name)
 		return -ENOMEM;
+	/*
+	 * zs_map_object() may lock a zspage that is being freed concurrently,
+	 * so the memory must remain a zspage, with its lock intact, for an
+	 * RCU grace period.
+	 */
 	pool->zspage_cachep = kmem_cache_create(name, sizeof(struct zspage),
-						0, 0, NULL);
+						0, SLAB_TYPESAFE_BY_RCU,
+						zspage_lock_init);
 	kfree(name);
 	if (!pool->zspage_cachep) {
 		kmem_cache_destroy(pool->handle_cachep);
@@ -339,8 +369,14 @@ static void cache_free_handle(struct zs_pool *pool, unsigned long handle)
 
 static struct zspage *cache_alloc_zspage(struct zs_pool *pool, gfp_t flags)
 {
-	return kmem_cache_zalloc(pool->zspage_cachep,
+	struct zspage *zspage;
+
+	zspage = kmem_cache_alloc(pool->zspage_cachep,
 			flags & ~(__GFP_HIGHMEM|__GFP_MOVABLE));
+	/* the lock may have concurrent lockless readers, leave it alone */
+	if (zspage)
+		memset(zspage, 0, offsetof(struct zspage, zsl));
+	return zspage;
 }
 
 static void cache_free_zspage(struct zs_pool *pool, struct zspage *zspage)
@@ -977,7 +1013,6 @@ static struct zspage *alloc_zspage(struct zs_pool *pool,
 		return NULL;
 
 	zspage->magic = ZSPAGE_MAGIC;
-	migrate_lock_init(zspage);
 
 	for (i = 0; i < class->pages_per_zspage; i++) {
 		struct page *page;
@@ -1191,6 +1226,7 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	struct size_class *class;
 	struct mapping_area *area;
 	struct page *pages[2];
+	unsigned int seq;
 	void *ret;
 
 	/*
@@ -1200,20 +1236,29 @@ void *zs_map_object(struct zs_pool *pool, unsigned long handle,
 	 */
 	BUG_ON(in_interrupt());
 
-	/* It guarantees it can get zspage from handle safely */
-	read_lock(&pool->migrate_lock);
-	obj = handle_to_obj(handle);
-	obj_to_location(obj, &page, &obj_idx);
-	zspage = get_zspage(page);
-
 	/*
-	 * migration cannot move any zpages in this zspage. Here, class->lock
-	 * is too heavy since callers would take some time until they calls
-	 * zs_unmap_object API so delegate the locking from class to zspage
-	 * which is smaller granularity.
+	 * Look the zspage up without pool->migrate_lock. Only migration and
+	 * compaction move objects, and both bump migrate_seq, so a lookup
+	 * that saw no writer before and after taking the zspage reader
+	 * reference found the zspage that holds the object. From then on
+	 * writers fail to trylock this zspage until zs_unmap_object().
 	 */
-	migrate_read_lock(zspage);
-	read_unlock(&pool->migrate_lock);
+	rcu_read_lock();
+	for (;;) {
+		seq = read_seqcount_begin(&pool->migrate_seq);
+		obj = handle_to_obj(handle);
+		obj_to_location(obj, &page, &obj_idx);
+		zspage = (struct zspage *)page_private(page);
+		if (read_seqcount_retry(&pool->migrate_seq, seq))
+			continue;
+
+		zspage_read_lock(zspage);
+		if (!read_seqcount_retry(&pool->migrate_seq, seq))
+			break;
+		zspage_read_unlock(zspage);
+	}
+	rcu_read_unlock();
+	VM_BUG_ON(zspage->magic != ZSPAGE_MAGIC);
 
 	class = zspage_class(pool, zspage);
 	off = offset_in_page(class->size * obj_idx);
@@ -1272,7 +1317,7 @@ void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
 	}
 	local_unlock(&zs_map_area.lock);
 
-	migrate_read_unlock(zspage);
+	zspage_read_unlock(zspage);
 }
 EXPORT_SYMBOL_GPL(zs_unmap_object);
 
@@ -1666,18 +1711,18 @@ static void lock_zspage(struct zspage *zspage)
 	/*
 	 * Pages we haven't locked yet can be migrated off the list while we're
 	 * trying to lock them, so we need to be careful and only attempt to
-	 * lock each page under migrate_read_lock(). Otherwise, the page we lock
+	 * lock each page under zspage_read_lock(). Otherwise, the page we lock
 	 * may no longer belong to the zspage. This means that we may wait for
 	 * the wrong page to unlock, so we must take a reference to the page
-	 * prior to waiting for it to unlock outside migrate_read_lock().
+	 * prior to waiting for it to unlock outside zspage_read_lock().
 	 */
 	while (1) {
-		migrate_read_lock(zspage);
+		zspage_read_lock(zspage);
 		page = get_first_page(zspage);
 		if (trylock_page(page))
 			break;
 		get_page(page);
-		migrate_read_unlock(zspage);
+		zspage_read_unlock(zspage);
 		wait_on_page_locked(page);
 		put_page(page);
 	}
@@ -1688,39 +1733,74 @@ static void lock_zspage(struct zspage *zspage)
 			curr_page = page;
 		} else {
 			get_page(page);
-			migrate_read_unlock(zspage);
+			zspage_read_unlock(zspage);
 			wait_on_page_locked(page);
 			put_page(page);
-			migrate_read_lock(zspage);
+			zspage_read_lock(zspage);
 		}
 	}
-	migrate_read_unlock(zspage);
+	zspage_read_unlock(zspage);
 }
 #endif /* CONFIG_COMPACTION */
 
-static void migrate_lock_init(struct zspage *zspage)
+static void zspage_lock_init(void *ptr)
 {
-	rwlock_init(&zspage->lock);
+	struct zspage_lock *zsl = &((struct zspage *)ptr)->zsl;
+
+	spin_lock_init(&zsl->lock);
+	zsl->cnt = ZS_PAGE_UNLOCKED;
 }
 
-static void migrate_read_lock(struct zspage *zspage) __acquires(&zspage->lock)
+static void zspage_read_lock(struct zspage *zspage)
 {
-	read_lock(&zspage->lock);
+	struct zspage_lock *zsl = &zspage->zsl;
+
+	spin_lock(&zsl->lock);
+	zsl->cnt++;
+	spin_unlock(&zsl->lock);
 }
 
-static void migrate_read_unlock(struct zspage *zspage) __releases(&zspage->lock)
+static void zspage_read_unlock(struct zspage *zspage)
 {
-	read_unlock(&zspage->lock);
+	struct zspage_lock *zsl = &zspage->zsl;
+
+	spin_lock(&zsl->lock);
+	zsl->cnt--;
+	spin_unlock(&zsl->lock);
 }
 
-static void migrate_write_lock(struct zspage *zspage)
+/* On success, returns with zsl->lock held until zspage_write_unlock(). */
+static __must_check bool zspage_write_trylock(struct zspage *zspage)
 {
-	write_lock(&zspage->lock);
+	struct zspage_lock *zsl = &zspage->zsl;
+
+	spin_lock(&zsl->lock);
+	if (zsl->cnt == ZS_PAGE_UNLOCKED) {
+		zsl->cnt = ZS_PAGE_WRLOCKED;
+		return true;
+	}
+	spin_unlock(&zsl->lock);
+	return false;
 }
 
-static void migrate_write_unlock(struct zspage *zspage)
+static void zspage_write_unlock(struct zspage *zspage)
 {
-	write_unlock(&zspage->lock);
+	struct zspage_lock *zsl = &zspage->zsl;
+
+	zsl->cnt = ZS_PAGE_UNLOCKED;
+	spin_unlock(&zsl->lock);
+}
+
+static void pool_write_lock(struct zs_pool *pool)
+{
+	write_lock(&pool->migrate_lock);
+	write_seqcount_begin(&pool->migrate_seq);
+}
+
+static void pool_write_unlock(struct zs_pool *pool)
+{
+	write_seqcount_end(&pool->migrate_seq);
+	write_unlock(&pool->migrate_lock);
 }
 
 #ifdef CONFIG_COMPACTION
@@ -1776,9 +1856,6 @@ static int zs_page_migrate(struct page *newpage, struct page *page,
 
 	VM_BUG_ON_PAGE(!PageIsolated(page), page);
 
-	/* We're committed, tell the world that this is a Zsmalloc page. */
-	__SetPageZsmalloc(newpage);
-
 	/* The page is locked, so this pointer must remain valid */
 	zspage = get_zspage(page);
 	pool = zspage->pool;
@@ -1787,15 +1864,25 @@ static int zs_page_migrate(struct page *newpage, struct page *page,
 	 * The pool migrate_lock protects the race between zpage migration
 	 * and zs_free.
 	 */
-	write_lock(&pool->migrate_lock);
+	pool_write_lock(pool);
 	class = zspage_class(pool, zspage);
 
 	/*
 	 * the class lock protects zpage alloc/free in the zspage.
 	 */
 	spin_lock(&class->lock);
-	/* the migrate_write_lock protects zpage access via zs_map_object */
-	migrate_write_lock(zspage);
+	/*
+	 * the zspage write lock protects zpage access via zs_map_object.
+	 * Mappers may sleep while holding it, so don't wait for them.
+	 */
+	if (!zspage_write_trylock(zspage)) {
+		spin_unlock(&class->lock);
+		pool_write_unlock(pool);
+		return -EAGAIN;
+	}
+
+	/* We're committed, tell the world that this is a Zsmalloc page. */
+	__SetPageZsmalloc(newpage);
 
 	offset = get_first_obj_offset(page);
 	s_addr = kmap_atomic(page);
@@ -1825,9 +1912,9 @@ static int zs_page_migrate(struct page *newpage, struct page *page,
 	 * Since we complete the data copy and set up new zspage structure,
 	 * it's okay to release migration_lock.
 	 */
-	write_unlock(&pool->migrate_lock);
+	zspage_write_unlock(zspage);
 	spin_unlock(&class->lock);
-	migrate_write_unlock(zspage);
+	pool_write_unlock(pool);
 
 	get_page(newpage);
 	if (page_zone(newpage) != page_zone(page)) {
@@ -1937,18 +2024,29 @@ static unsigned long zs_can_compact(struct size_class *class)
 	return obj_wasted * class->pages_per_zspage;
 }
 
+static void putback_zspages(struct size_class *class, struct list_head *list)
+{
+	struct zspage *zspage, *tmp;
+
+	list_for_each_entry_safe(zspage, tmp, list, list) {
+		list_del_init(&zspage->list);
+		putback_zspage(class, zspage);
+	}
+}
+
 static unsigned long __zs_compact(struct zs_pool *pool,
 				  struct size_class *class)
 {
 	struct zspage *src_zspage = NULL;
 	struct zspage *dst_zspage = NULL;
 	unsigned long pages_freed = 0;
+	LIST_HEAD(skipped);
 
 	/*
 	 * protect the race between zpage migration and zs_free
 	 * as well as zpage allocation/free
 	 */
-	write_lock(&pool->migrate_lock);
+	pool_write_lock(pool);
 	spin_lock(&class->lock);
 	while (zs_can_compact(class)) {
 		int fg;
@@ -1963,9 +2061,19 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 		if (!src_zspage)
 			break;
 
-		migrate_write_lock(src_zspage);
+		/*
+		 * A mapped zspage can't be migrated now, as in
+		 * zs_page_migrate(). Set it aside and try the next one, it
+		 * is put back before class->lock is dropped.
+		 */
+		if (!zspage_write_trylock(src_zspage)) {
+			list_add(&src_zspage->list, &skipped);
+			src_zspage = NULL;
+			continue;
+		}
+
 		migrate_zspage(pool, src_zspage, dst_zspage);
-		migrate_write_unlock(src_zspage);
+		zspage_write_unlock(src_zspage);
 
 		fg = putback_zspage(class, src_zspage);
 		if (fg == ZS_INUSE_RATIO_0) {
@@ -1978,11 +2086,12 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 		    || rwlock_is_contended(&pool->migrate_lock)) {
 			putback_zspage(class, dst_zspage);
 			dst_zspage = NULL;
+			putback_zspages(class, &skipped);
 
 			spin_unlock(&class->lock);
-			write_unlock(&pool->migrate_lock);
+			pool_write_unlock(pool);
 			cond_resched();
-			write_lock(&pool->migrate_lock);
+			pool_write_lock(pool);
 			spin_lock(&class->lock);
 		}
 	}
@@ -1993,8 +2102,10 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 	if (dst_zspage)
 		putback_zspage(class, dst_zspage);
 
+	putback_zspages(class, &skipped);
+
 	spin_unlock(&class->lock);
-	write_unlock(&pool->migrate_lock);
+	pool_write_unlock(pool);
 
 	return pages_freed;
 }
@@ -2132,6 +2243,7 @@ struct zs_pool *zs_create_pool(const char *name)
 
 	init_deferred_free(pool);
 	rwlock_init(&pool->migrate_lock);
+	seqcount_rwlock_init(&pool->migrate_seq, &pool->migrate_lock);
 	atomic_set(&pool->compaction_in_progress, 0);
 
 	pool->name = kstrdup(name, GFP_KERNEL);
@@ -35,6 +35,7 @@
 #include <linux/pagemap.h>
 #include <linux/workqueue.h>
 #include <linux/list_lru.h>
+#include <linux/sched/mm.h>
 
 #include "swap.h"
 #include "internal.h"
@@ -69,6 +70,8 @@ static u64 zswap_reject_kmemcache_fail;
 
 /* Shrinker work queue */
 static struct workqueue_struct *shrink_wq;
+/* Parallel compression of large folios */
+static struct workqueue_struct *compress_wq;
 /* Pool limit was hit, we need to calm down */
 static bool zswap_pool_reached_full;
 
@@ -916,9 +919,14 @@ static void acomp_ctx_put_unlock(struct crypto_acomp_ctx *acomp_ctx)
 	mutex_unlock(&acomp_ctx->mutex);
 }
 
-static bool zswap_compress(struct folio *folio, struct zswap_entry *entry)
+/*
+ * Compress @page into a new zpool allocation for @entry. The caller holds
+ * @acomp_ctx, so that a run of pages of a large folio is compressed under
+ * a single acquisition of the per-CPU context.
+ */
+static bool zswap_compress(struct page *page, struct zswap_entry *entry,
+			   struct crypto_acomp_ctx *acomp_ctx)
 {
-	struct crypto_acomp_ctx *acomp_ctx;
 	struct scatterlist input, output;
 	int comp_ret = 0, alloc_ret = 0;
 	unsigned int dlen = PAGE_SIZE;
@@ -928,10 +936,9 @@ static bool zswap_compress(struct folio *folio, struct zswap_entry *entry)
 	gfp_t gfp;
 	u8 *dst;
 
-	acomp_ctx = acomp_ctx_get_cpu_lock(entry->pool);
 	dst = acomp_ctx->buffer;
 	sg_init_table(&input, 1);
-	sg_set_folio(&input, folio, PAGE_SIZE, 0);
+	sg_set_page(&input, page, PAGE_SIZE, 0);
 
 	/*
 	 * We need PAGE_SIZE * 2 here since there maybe over-compression case,
@@ -981,11 +988,10 @@ static bool zswap_compress(struct folio *folio, struct zswap_entry *entry)
 	else if (alloc_ret)
 		zswap_reject_alloc_fail++;
 
-	acomp_ctx_put_unlock(acomp_ctx);
 	return comp_ret == 0 && alloc_ret == 0;
 }
 
-static void zswap_decompress(struct zswap_entry *entry, struct folio *folio)
+static void zswap_decompress(struct zswap_entry *entry, struct page *page)
 {
 	struct zpool *zpool = entry->pool->zpool;
 	struct scatterlist input, output;
@@ -1012,7 +1018,7 @@ static void zswap_decompress(struct zswap_entry *entry, struct folio *folio)
 
 	sg_init_one(&input, src, entry->length);
 	sg_init_table(&output, 1);
-	sg_set_folio(&output, folio, PAGE_SIZE, 0);
+	sg_set_page(&output, page, PAGE_SIZE, 0);
 	acomp_request_set_params(acomp_ctx->req, &input, &output, entry->length, PAGE_SIZE);
 	BUG_ON(crypto_wait_req(crypto_acomp_decompress(acomp_ctx->req), &acomp_ctx->wait));
 	BUG_ON(acomp_ctx->req->dlen != PAGE_SIZE);
@@ -1085,7 +1091,7 @@ static int zswap_writeback_entry(struct zswap_entry *entry,
 		return -ENOMEM;
 	}
 
-	zswap_decompress(entry, folio);
+	zswap_decompress(entry, &folio->page);
 
 	count_vm_event(ZSWPWB);
 	if (entry->objcg)
@@ -1264,7 +1270,8 @@ static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
 	 * Without memcg, use the zswap pool-wide metrics.
 	 */
 	if (!mem_cgroup_disabled()) {
-		mem_cgroup_flush_stats(memcg);
+		/* Writeback is sized from these, don't use stale stats */
+		mem_cgroup_flush_stats_bounded(memcg, 0);
 		nr_backing = memcg_page_state(memcg, MEMCG_ZSWAP_B) >> PAGE_SHIFT;
 		nr_stored = memcg_page_state(memcg, MEMCG_ZSWAPPED);
 	} else {
@@ -1439,74 +1446,70 @@ static void shrink_worker(struct work_struct *w)
 /*********************************
 * main API
 **********************************/
-bool zswap_store(struct folio *folio)
+/*
+ * Compress @page into a new, not yet published entry. Returns NULL if the
+ * entry could not be allocated or the page could not be stored.
+ */
+static struct zswap_entry *zswap_compress_page(struct page *page,
+					       struct zswap_pool *pool,
+					       struct crypto_acomp_ctx *acomp_ctx)
 {
-	swp_entry_t swp = folio->swap;
-	pgoff_t offset = swp_offset(swp);
-	struct xarray *tree = swap_zswap_tree(swp);
-	struct zswap_entry *entry, *old;
-	struct obj_cgroup *objcg = NULL;
-	struct mem_cgroup *memcg = NULL;
-
-	VM_WARN_ON_ONCE(!folio_test_locked(folio));
-	VM_WARN_ON_ONCE(!folio_test_swapcache(folio));
-
-	/* Large folios aren't supported */
-	if (folio_test_large(folio))
-		return false;
-
-	if (!zswap_enabled)
-		goto check_old;
-
-	/* Check cgroup limits */
-	objcg = get_obj_cgroup_from_folio(folio);
-	if (objcg && !obj_cgroup_may_zswap(objcg)) {
-		memcg = get_mem_cgroup_from_objcg(objcg);
-		if (shrink_memcg(memcg)) {
-			mem_cgroup_put(memcg);
-			goto reject;
-		}
-		mem_cgroup_put(memcg);
-	}
-
-	if (zswap_check_limits())
-		goto reject;
+	struct zswap_entry *entry;
 
-	/* allocate entry */
-	entry = zswap_entry_cache_alloc(GFP_KERNEL, folio_nid(folio));
+	entry = zswap_entry_cache_alloc(GFP_KERNEL, page_to_nid(page));
 	if (!entry) {
 		zswap_reject_kmemcache_fail++;
-		goto reject;
+		return NULL;
 	}
 
 	/* if entry is successfully added, it keeps the reference */
-	entry->pool = zswap_pool_current_get();
-	if (!entry->pool)
+	if (!zswap_pool_get(pool))
 		goto freepage;
+	entry->pool = pool;
 
-	if (objcg) {
-		memcg = get_mem_cgroup_from_objcg(objcg);
-		if (memcg_list_lru_alloc(memcg, &zswap_list_lru, GFP_KERNEL)) {
-			mem_cgroup_put(memcg);
-			goto put_pool;
-		}
-		mem_cgroup_put(memcg);
-	}
-
-	if (!zswap_compress(folio, entry))
+	if (!zswap_compress(page, entry, acomp_ctx))
 		goto put_pool;
 
-	entry->swpentry = swp;
-	entry->objcg = objcg;
+	entry->swpentry = page_swap_entry(page);
 	entry->referenced = true;
+	return entry;
+
+put_pool:
+	zswap_pool_put(pool);
+freepage:
+	zswap_entry_cache_free(entry);
+	return NULL;
+}
+
+/* Free an entry that zswap_compress_page() returned but was never stored */
+static void zswap_entry_discard(struct zswap_entry *entry)
+{
+	zpool_free(entry->pool->zpool, entry->handle);
+	zswap_pool_put(entry->pool);
+	zswap_entry_cache_free(entry);
+}
+
+static bool zswap_store_entry(struct zswap_entry *entry,
+			      struct obj_cgroup *objcg)
+{
+	swp_entry_t swp = entry->swpentry;
+	struct zswap_entry *old;
+
+	/* the entry owns a reference to objcg once it is visible */
+	if (objcg)
+		obj_cgroup_get(objcg);
+	entry->objcg = objcg;
 
-	old = xa_store(tree, offset, entry, GFP_KERNEL);
+	old = xa_store(swap_zswap_tree(swp), swp_offset(swp), entry,
+		       GFP_KERNEL);
 	if (xa_is_err(old)) {
 		int err = xa_err(old);
 
 		WARN_ONCE(err != -ENOMEM, "unexpected xarray error: %d\n", err);
 		zswap_reject_alloc_fail++;
-		goto store_failed;
+		obj_cgroup_put(objcg);
+		zswap_entry_discard(entry);
+		return false;
 	}
 
 	/*
@@ -1542,36 +1545,253 @@ bool zswap_store(struct folio *folio)
 	count_vm_event(ZSWPOUT);
 
 	return true;
+}
+
+/*
+ * Large folios are compressed in parallel: the pages are split into up to
+ * ZSWAP_STORE_MAX_WORKS runs of at least ZSWAP_STORE_BATCH pages, and each
+ * run after the first is compressed by a worker on compress_wq, using the
+ * per-CPU acomp context and zpool of the CPU it runs on. The storing task
+ * compresses the first run itself, then waits for the workers and only
+ * publishes the entries once every page has been compressed.
+ */
+#define ZSWAP_STORE_BATCH	16
+#define ZSWAP_STORE_MAX_WORKS	8L
+
+struct zswap_store_work {
+	struct work_struct work;
+	struct folio *folio;
+	struct zswap_pool *pool;
+	struct zswap_entry **entries;
+	long start, end;
+	bool *failed;
+};
+
+static void zswap_compress_range(struct zswap_store_work *w)
+{
+	struct crypto_acomp_ctx *acomp_ctx;
+	long index;
+
+	acomp_ctx = acomp_ctx_get_cpu_lock(w->pool);
+	for (index = w->start; index < w->end; index++) {
+		if (READ_ONCE(*w->failed))
+			break;
+		w->entries[index] = zswap_compress_page(folio_page(w->folio, index),
+							w->pool, acomp_ctx);
+		if (!w->entries[index]) {
+			WRITE_ONCE(*w->failed, true);
+			break;
+		}
+	}
+	acomp_ctx_put_unlock(acomp_ctx);
+}
+
+static void zswap_compress_work(struct work_struct *work)
+{
+	struct zswap_store_work *w = container_of(work, typeof(*w), work);
+	unsigned int noreclaim_flag;
+
+	/* we compress on behalf of reclaim, don't recurse into it */
+	noreclaim_flag = memalloc_noreclaim_save();
+	zswap_compress_range(w);
+	memalloc_noreclaim_restore(noreclaim_flag);
+}
+
+/*
+ * Compress every page of @folio into @entries. The work array is only
+ * allocated opportunistically; without it, the folio is compressed by the
+ * calling task alone.
+ */
+static bool zswap_compress_folio(struct folio *folio, struct zswap_pool *pool,
+				 struct zswap_entry **entries)
+{
+	long nr_pages = folio_nr_pages(folio);
+	struct zswap_store_work *works = NULL;
+	struct zswap_store_work first;
+	bool failed = false;
+	long nr_works, per_work, i;
+
+	nr_works = min_t(long, nr_pages / ZSWAP_STORE_BATCH, num_online_cpus());
+	nr_works = min(nr_works, ZSWAP_STORE_MAX_WORKS);
+	if (nr_works > 1)
+		works = kmalloc_array(nr_works - 1, sizeof(*works),
+				      GFP_NOWAIT | __GFP_NOWARN);
+	if (!works)
+		nr_works = 1;
+	per_work = DIV_ROUND_UP(nr_pages, nr_works);
+
+	for (i = 0; i < nr_works; i++) {
+		struct zswap_store_work *w = i ? &works[i - 1] : &first;
+
+		w->folio = folio;
+		w->pool = pool;
+		w->entries = entries;
+		w->start = i * per_work;
+		w->end = min(nr_pages, w->start + per_work);
+		w->failed = &failed;
+		if (i) {
+			INIT_WORK(&w->work, zswap_compress_work);
+			queue_work(compress_wq, &w->work);
+		}
+	}
+
+	zswap_compress_range(&first);
+	for (i = 1; i < nr_works; i++)
+		flush_work(&works[i - 1].work);
+	kfree(works);
+
+	return !failed;
+}
+
+/*
+ * Store every page of @folio as its own zswap entry. Large folios are
+ * stored whole or not at all: the cgroup and pool limits are checked once,
+ * all pages are compressed, in parallel for large folios, and the entries
+ * are only published once every page compressed. If publishing one fails,
+ * the entries already stored for the folio are dropped again.
+ */
+bool zswap_store(struct folio *folio)
+{
+	long nr_pages = folio_nr_pages(folio);
+	swp_entry_t swp = folio->swap;
+	struct zswap_entry **entries, *single = NULL;
+	struct obj_cgroup *objcg = NULL;
+	struct mem_cgroup *memcg = NULL;
+	struct zswap_entry *entry;
+	struct zswap_pool *pool;
+	bool ret = false;
+	long index;
+
+	VM_WARN_ON_ONCE(!folio_test_locked(folio));
+	VM_WARN_ON_ONCE(!folio_test_swapcache(folio));
+
+	if (!zswap_enabled)
+		goto check_old;
+
+	/* Check cgroup limits */
+	objcg = get_obj_cgroup_from_folio(folio);
+	if (objcg && !obj_cgroup_may_zswap(objcg)) {
+		memcg = get_mem_cgroup_from_objcg(objcg);
+		if (shrink_memcg(memcg)) {
+			mem_cgroup_put(memcg);
+			goto put_objcg;
+		}
+		mem_cgroup_put(memcg);
+	}
+
+	if (zswap_check_limits())
+		goto put_objcg;
+
+	pool = zswap_pool_current_get();
+	if (!pool)
+		goto put_objcg;
+
+	if (objcg) {
+		memcg = get_mem_cgroup_from_objcg(objcg);
+		if (memcg_list_lru_alloc(memcg, &zswap_list_lru, GFP_KERNEL)) {
+			mem_cgroup_put(memcg);
+			goto put_pool;
+		}
+		mem_cgroup_put(memcg);
+	}
+
+	if (nr_pages == 1) {
+		entries = &single;
+	} else {
+		entries = kcalloc(nr_pages, sizeof(*entries), GFP_KERNEL);
+		if (!entries) {
+			zswap_reject_kmemcache_fail++;
+			goto put_pool;
+		}
+	}
+
+	if (zswap_compress_folio(folio, pool, entries)) {
+		for (index = 0; index < nr_pages; ++index) {
+			entry = entries[index];
+			entries[index] = NULL;
+			if (!zswap_store_entry(entry, objcg))
+				break;
+		}
+		ret = index == nr_pages;
+	}
+
+	/* discard the entries that were compressed but not stored */
+	for (index = 0; index < nr_pages; ++index) {
+		if (entries[index])
+			zswap_entry_discard(entries[index]);
+	}
+	if (entries != &single)
+		kfree(entries);
 
-store_failed:
-	zpool_free(entry->pool->zpool, entry->handle);
 put_pool:
-	zswap_pool_put(entry->pool);
-freepage:
-	zswap_entry_cache_free(entry);
-reject:
+	zswap_pool_put(pool);
+put_objcg:
 	obj_cgroup_put(objcg);
-	if (zswap_pool_reached_full)
+	if (!ret && zswap_pool_reached_full)
 		queue_work(shrink_wq, &zswap_shrink_work);
 check_old:
 	/*
-	 * If the zswap store fails or zswap is disabled, we must invalidate the
-	 * possibly stale entry which was previously stored at this offset.
+	 * If the zswap store fails or zswap is disabled, we must invalidate
+	 * the possibly stale entries which were previously stored at the
+	 * offsets of this folio, as well as any stored for it above.
 	 * Otherwise, writeback could overwrite the new data in the swapfile.
 	 */
-	entry = xa_erase(tree, offset);
-	if (entry)
-		zswap_entry_free(entry);
-	return false;
+	if (!ret) {
+		for (index = 0; index < nr_pages; ++index) {
+			swp_entry_t page_swp = swp_entry(swp_type(swp),
+							 swp_offset(swp) + index);
+
+			entry = xa_erase(swap_zswap_tree(page_swp),
+					 swp_offset(page_swp));
+			if (entry)
+				zswap_entry_free(entry);
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * Return the number of swap entries from @swp on, up to @max_nr, that are
+ * all in zswap or all not in it, and in @present which of the two it is.
+ * Swapin only allocates a large folio for a range that zswap_load() can
+ * load in one go.
+ */
+int zswap_present_batch(swp_entry_t swp, int max_nr, bool *present)
+{
+	bool first = false;
+	int nr;
+
+	if (zswap_never_enabled()) {
+		nr = max_nr;
+		goto out;
+	}
+
+	for (nr = 0; nr < max_nr; nr++) {
+		swp_entry_t page_swp = swp_entry(swp_type(swp),
+						 swp_offset(swp) + nr);
+		bool stored = xa_load(swap_zswap_tree(page_swp),
+				      swp_offset(page_swp));
+
+		if (!nr)
+			first = stored;
+		else if (stored != first)
+			break;
+	}
+out:
+	if (present)
+		*present = first;
+	return nr;
 }
 
 bool zswap_load(struct folio *folio)
 {
+	long nr_pages = folio_nr_pages(folio);
 	swp_entry_t swp = folio->swap;
-	pgoff_t offset = swp_offset(swp);
 	bool swapcache = folio_test_swapcache(folio);
-	struct xarray *tree = swap_zswap_tree(swp);
 	struct zswap_entry *entry;
+	bool present;
+	long index;
 
 	VM_WARN_ON_ONCE(!folio_test_locked(folio));
 
@@ -1579,47 +1799,62 @@ bool zswap_load(struct folio *folio)
 		return false;
 
 	/*
-	 * Large folios should not be swapped in while zswap is being used, as
-	 * they are not properly handled. Zswap does not properly load large
-	 * folios, and a large folio may only be partially in zswap.
-	 *
-	 * Return true without marking the folio uptodate so that an IO error is
-	 * emitted (e.g. do_swap_page() will sigbus).
+	 * Large folios are only loaded if all of their pages are in zswap,
+	 * swapin checks that with zswap_present_batch() under the swap cache
+	 * flag, which keeps writeback away. If the folio is partially in
+	 * zswap anyway, return true without marking it uptodate so that an
+	 * IO error is emitted (e.g. do_swap_page() will sigbus).
 	 */
-	if (WARN_ON_ONCE(folio_test_large(folio)))
-		return true;
+	if (folio_test_large(folio)) {
+		if (WARN_ON_ONCE(zswap_present_batch(swp, nr_pages, &present) !=
+				 nr_pages))
+			return true;
+		if (!present)
+			return false;
+	}
 
-	/*
-	 * When reading into the swapcache, invalidate our entry. The
-	 * swapcache can be the authoritative owner of the page and
-	 * its mappings, and the pressure that results from having two
-	 * in-memory copies outweighs any benefits of caching the
-	 * compression work.
-	 *
-	 * (Most swapins go through the swapcache. The notable
-	 * exception is the singleton fault on SWP_SYNCHRONOUS_IO
-	 * files, which reads into a private page and may free it if
-	 * the fault fails. We remain the primary owner of the entry.)
-	 */
-	if (swapcache)
-		entry = xa_erase(tree, offset);
-	else
-		entry = xa_load(tree, offset);
+	for (index = 0; index < nr_pages; ++index) {
+		swp_entry_t page_swp = swp_entry(swp_type(swp),
+						 swp_offset(swp) + index);
+		struct xarray *tree = swap_zswap_tree(page_swp);
+		pgoff_t offset = swp_offset(page_swp);
 
-	if (!entry)
-		return false;
+		/*
+		 * When reading into the swapcache, invalidate our entry. The
+		 * swapcache can be the authoritative owner of the page and
+		 * its mappings, and the pressure that results from having two
+		 * in-memory copies outweighs any benefits of caching the
+		 * compression work.
+		 *
+		 * (Most swapins go through the swapcache. The notable
+		 * exception is the singleton fault on SWP_SYNCHRONOUS_IO
+		 * files, which reads into a private page and may free it if
+		 * the fault fails. We remain the primary owner of the entry.)
+		 */
+		if (swapcache)
+			entry = xa_erase(tree, offset);
+		else
+			entry = xa_load(tree, offset);
 
-	zswap_decompress(entry, folio);
+		if (!entry) {
+			/* large folios were checked to be in zswap above */
+			VM_WARN_ON_ONCE(index);
+			return false;
+		}
 
-	count_vm_event(ZSWPIN);
-	if (entry->objcg)
-		count_objcg_events(entry->objcg, ZSWPIN, 1);
+		zswap_decompress(entry, folio_page(folio, index));
 
-	if (swapcache) {
-		zswap_entry_free(entry);
-		folio_mark_dirty(folio);
+		count_vm_event(ZSWPIN);
+		if (entry->objcg)
+			count_objcg_events(entry->objcg, ZSWPIN, 1);
+
+		if (swapcache)
+			zswap_entry_free(entry);
 	}
 
+	if (swapcache)
+		folio_mark_dirty(folio);
+
 	folio_mark_uptodate(folio);
 	return true;
 }
@@ -1748,6 +1983,11 @@ static int zswap_setup(void)
 	if (!shrink_wq)
 		goto shrink_wq_fail;
 
+	compress_wq = alloc_workqueue("zswap-compress",
+			WQ_UNBOUND|WQ_MEM_RECLAIM, 0);
+	if (!compress_wq)
+		goto compress_wq_fail;
+
 	zswap_shrinker = zswap_alloc_shrinker();
 	if (!zswap_shrinker)
 		goto shrinker_fail;
@@ -1777,6 +2017,8 @@ static int zswap_setup(void)
 lru_fail:
 	shrinker_free(zswap_shrinker);
 shrinker_fail:
+	destroy_workqueue(compress_wq);
+compress_wq_fail:
 	destroy_workqueue(shrink_wq);
 shrink_wq_fail:
 	cpuhp_remove_multi_state(CPUHP_MM_ZSWP_POOL_PREPARE);
@@ -6421,7 +6421,8 @@ static void busy_poll_stop(struct napi_struct *napi, void *have_poll_lock,
 	local_bh_enable();
 }
 
-static void __napi_busy_loop(unsigned int napi_id,
+/* Returns the number of packets polled. */
+static int __napi_busy_loop(unsigned int napi_id,
 		      bool (*loop_end)(void *, unsigned long),
 		      void *loop_end_arg, unsigned flags, u16 budget)
 {
@@ -6430,6 +6431,7 @@ static void __napi_busy_loop(unsigned int napi_id,
 	struct bpf_net_context __bpf_net_ctx, *bpf_net_ctx;
 	void *have_poll_lock = NULL;
 	struct napi_struct *napi;
+	int total = 0;
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
@@ -6438,7 +6440,7 @@ static void __napi_busy_loop(unsigned int napi_id,
 
 	napi = napi_by_id(napi_id);
 	if (!napi)
-		return;
+		return total;
 
 	if (!IS_ENABLED(CONFIG_PREEMPT_RT))
 		preempt_disable();
@@ -6473,9 +6475,11 @@ static void __napi_busy_loop(unsigned int napi_id,
 		trace_napi_poll(napi, work, budget);
 		gro_normal_list(napi);
 count:
-		if (work > 0)
+		if (work > 0) {
 			__NET_ADD_STATS(dev_net(napi->dev),
 					LINUX_MIB_BUSYPOLLRXPACKETS, work);
+			total += work;
+		}
 		skb_defer_free_flush(this_cpu_ptr(&softnet_data));
 		bpf_net_ctx_clear(bpf_net_ctx);
 		local_bh_enable();
@@ -6494,7 +6498,7 @@ static void __napi_busy_loop(unsigned int napi_id,
 			cond_resched();
 			rcu_read_lock();
 			if (loop_end(loop_end_arg, start_time))
-				return;
+				return total;
 			goto restart;
 		}
 		cpu_relax();
@@ -6503,18 +6507,20 @@ static void __napi_busy_loop(unsigned int napi_id,
 		busy_poll_stop(napi, have_poll_lock, flags, budget);
 	if (!IS_ENABLED(CONFIG_PREEMPT_RT))
 		preempt_enable();
+	return total;
 }
 
-void napi_busy_loop_rcu(unsigned int napi_id,
-			bool (*loop_end)(void *, unsigned long),
-			void *loop_end_arg, bool prefer_busy_poll, u16 budget)
+int napi_busy_loop_rcu(unsigned int napi_id,
+		       bool (*loop_end)(void *, unsigned long),
+		       void *loop_end_arg, bool prefer_busy_poll, u16 budget)
 {
 	unsigned flags = NAPI_F_END_ON_RESCHED;
 
 	if (prefer_busy_poll)
 		flags |= NAPI_F_PREFER_BUSY_POLL;
 
-	__napi_busy_loop(napi_id, loop_end, loop_end_arg, flags, budget);
+	return __napi_busy_loop(napi_id, loop_end, loop_end_arg, flags,
+				budget);
 }
 
 void napi_busy_loop(unsigned int napi_id,